@@ -0,0 +1,446 @@
+// Microbenchmarks for creating, calling, and releasing thunks
+//
+// Every benchmark is run as a number of rounds. Each round times a small batch
+// of operations, so the cost of reading the clock is amortized, and records
+// the average time per operation in that batch as one sample. Percentiles are
+// taken over those samples.
+//
+// Results go to standard output as tab-separated values, one benchmark per
+// line, after a header line. Progress and errors go to standard error.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "curry.h"
+
+// Number of operations timed together in one sample
+#define BENCH_BATCH 64
+
+// Defaults for the command-line parameters
+#define BENCH_DEFAULT_ROUNDS 2000
+#define BENCH_DEFAULT_THREADS 8
+
+static size_t bench_rounds = BENCH_DEFAULT_ROUNDS;
+
+// -----------------------------------------------------------------------------
+// Timing and reporting
+
+static uint64_t bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int bench_compare(const void *a, const void *b) {
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Print one result line. The samples are nanoseconds per operation, and they
+// get sorted in place. Throughput is computed from the wall-clock time the
+// whole benchmark took, so that it's meaningful with many threads.
+static void bench_report(const char *name, const char *shape, size_t threads,
+                         double *samples, size_t nsamples, uint64_t ops,
+                         uint64_t wall_ns) {
+  qsort(samples, nsamples, sizeof(*samples), bench_compare);
+  double sum = 0;
+  for (size_t i = 0; i < nsamples; i++)
+    sum += samples[i];
+#define PCT(p) samples[(size_t)((nsamples - 1) * (p) / 100)]
+  printf("%s\t%s\t%zu\t%zu\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\t%.3f\n", name, shape,
+         threads, nsamples, sum / nsamples, PCT(50), PCT(90), PCT(99),
+         samples[nsamples - 1], (double)ops * 1000 / wall_ns);
+#undef PCT
+  fflush(stdout);
+}
+
+static double *bench_samples(size_t n) {
+  double *const samples = malloc(n * sizeof(*samples));
+  if (samples == NULL) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(1);
+  }
+  return samples;
+}
+
+static void bench_check(const void *p) {
+  if (p == NULL) {
+    fprintf(stderr, "bench: failed to create thunk\n");
+    exit(1);
+  }
+}
+
+// -----------------------------------------------------------------------------
+// Functions being curried. They're kept out of line so the compiler can't see
+// through the baseline.
+
+static uint64_t bench_sink;
+
+__attribute__((noinline)) static uint64_t fn_reg(uint64_t a0, uint64_t a1,
+                                                 uint64_t a2, uint64_t a3,
+                                                 uint64_t a4, uint64_t a5) {
+  return a0 + a1 + a2 + a3 + a4 + a5;
+}
+
+__attribute__((noinline)) static uint64_t
+fn_overflow(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4,
+            uint64_t a5, uint64_t a6, uint64_t a7, uint64_t a8, uint64_t a9,
+            uint64_t a10, uint64_t a11) {
+  return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11;
+}
+
+// For the largest shape, only the first argument is looked at
+__attribute__((noinline)) static uint64_t fn_max(uint64_t a0, ...) {
+  return a0;
+}
+
+// -----------------------------------------------------------------------------
+// Hand-written closures, as a baseline. This is what a caller would write
+// without this library: a heap-allocated struct holding the bound arguments,
+// and a helper that unpacks it.
+
+typedef struct closure_t {
+  void *fn;
+  uint64_t args[];
+} closure_t;
+
+static closure_t *closure_new(void *fn, size_t nargs, const uint64_t *args) {
+  closure_t *const c = malloc(sizeof(closure_t) + nargs * sizeof(uint64_t));
+  if (c == NULL)
+    return NULL;
+  c->fn = fn;
+  memcpy(c->args, args, nargs * sizeof(uint64_t));
+  return c;
+}
+
+__attribute__((noinline)) static uint64_t
+closure_call_reg(const closure_t *c, uint64_t a3, uint64_t a4, uint64_t a5) {
+  uint64_t (*const fn)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                       uint64_t) = c->fn;
+  return fn(c->args[0], c->args[1], c->args[2], a3, a4, a5);
+}
+
+__attribute__((noinline)) static uint64_t
+closure_call_overflow(const closure_t *c, uint64_t a8, uint64_t a9,
+                      uint64_t a10, uint64_t a11) {
+  uint64_t (*const fn)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                       uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                       uint64_t, uint64_t) = c->fn;
+  return fn(c->args[0], c->args[1], c->args[2], c->args[3], c->args[4],
+            c->args[5], c->args[6], c->args[7], a8, a9, a10, a11);
+}
+
+// -----------------------------------------------------------------------------
+// Single-threaded benchmarks
+
+typedef uint64_t (*thunk_reg_t)(uint64_t, uint64_t, uint64_t);
+typedef uint64_t (*thunk_overflow_t)(uint64_t, uint64_t, uint64_t, uint64_t);
+typedef uint64_t (*thunk_max_t)(void);
+
+static const uint64_t bench_args[CURRY_MAX_ARGS] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+// Creating thunks, and releasing persistent ones. One-shot thunks are released
+// by calling them, which isn't timed.
+static void bench_create(void) {
+  double *const create = bench_samples(bench_rounds);
+  double *const release = bench_samples(bench_rounds);
+  void *batch[BENCH_BATCH];
+
+  for (int persistent = 0; persistent <= 1; persistent++) {
+    const uint64_t start = bench_now();
+    uint64_t release_ns = 0;
+    for (size_t r = 0; r < bench_rounds; r++) {
+      const uint64_t t0 = bench_now();
+      for (size_t i = 0; i < BENCH_BATCH; i++)
+        batch[i] = persistent ? curry_persistent(fn_reg, 3, 3, r, i, 0)
+                              : curry(fn_reg, 3, 3, r, i, 0);
+      const uint64_t t1 = bench_now();
+      for (size_t i = 0; i < BENCH_BATCH; i++) {
+        bench_check(batch[i]);
+        if (persistent)
+          curry_free(batch[i]);
+        else
+          bench_sink += ((thunk_reg_t)batch[i])(0, 0, 0);
+      }
+      const uint64_t t2 = bench_now();
+      create[r] = (double)(t1 - t0) / BENCH_BATCH;
+      release[r] = (double)(t2 - t1) / BENCH_BATCH;
+      release_ns += t2 - t1;
+    }
+    const uint64_t wall = bench_now() - start - release_ns;
+    bench_report("create", persistent ? "persistent/3+3" : "oneshot/3+3", 1,
+                 create, bench_rounds, bench_rounds * BENCH_BATCH, wall);
+    if (persistent)
+      bench_report("free", "persistent/3+3", 1, release, bench_rounds,
+                   bench_rounds * BENCH_BATCH, release_ns);
+  }
+
+  // The same, with hand-written closures
+  const uint64_t start = bench_now();
+  uint64_t release_ns = 0;
+  for (size_t r = 0; r < bench_rounds; r++) {
+    const uint64_t t0 = bench_now();
+    for (size_t i = 0; i < BENCH_BATCH; i++)
+      batch[i] = closure_new(fn_reg, 3, (const uint64_t[]){r, i, 0});
+    const uint64_t t1 = bench_now();
+    for (size_t i = 0; i < BENCH_BATCH; i++) {
+      bench_check(batch[i]);
+      free(batch[i]);
+    }
+    const uint64_t t2 = bench_now();
+    create[r] = (double)(t1 - t0) / BENCH_BATCH;
+    release[r] = (double)(t2 - t1) / BENCH_BATCH;
+    release_ns += t2 - t1;
+  }
+  const uint64_t wall = bench_now() - start - release_ns;
+  bench_report("create", "closure/3+3", 1, create, bench_rounds,
+               bench_rounds * BENCH_BATCH, wall);
+  bench_report("free", "closure/3+3", 1, release, bench_rounds,
+               bench_rounds * BENCH_BATCH, release_ns);
+
+  free(create);
+  free(release);
+}
+
+// Calling persistent thunks over and over, compared against closures
+static void bench_call(void) {
+  double *const samples = bench_samples(bench_rounds);
+
+#define BENCH_CALL_LOOP(name, shape, call)                                     \
+  do {                                                                         \
+    const uint64_t start = bench_now();                                        \
+    for (size_t r = 0; r < bench_rounds; r++) {                                \
+      const uint64_t t0 = bench_now();                                         \
+      for (size_t i = 0; i < BENCH_BATCH; i++)                                 \
+        bench_sink += (call);                                                  \
+      samples[r] = (double)(bench_now() - t0) / BENCH_BATCH;                   \
+    }                                                                          \
+    bench_report(name, shape, 1, samples, bench_rounds,                        \
+                 bench_rounds * BENCH_BATCH, bench_now() - start);             \
+  } while (0)
+
+  const thunk_reg_t reg = curry_array_persistent(fn_reg, 3, 3, bench_args);
+  const thunk_overflow_t overflow =
+      curry_array_persistent(fn_overflow, 8, 4, bench_args);
+  const thunk_max_t max =
+      curry_array_persistent(fn_max, CURRY_MAX_ARGS, 0, bench_args);
+  bench_check(reg);
+  bench_check(overflow);
+  bench_check(max);
+  BENCH_CALL_LOOP("call", "persistent/3+3", reg(4, 5, i));
+  BENCH_CALL_LOOP("call", "persistent/8+4", overflow(9, 10, 11, i));
+  BENCH_CALL_LOOP("call", "persistent/256+0", max());
+  curry_free(reg);
+  curry_free(overflow);
+  curry_free(max);
+
+  closure_t *const creg = closure_new(fn_reg, 3, bench_args);
+  closure_t *const coverflow = closure_new(fn_overflow, 8, bench_args);
+  bench_check(creg);
+  bench_check(coverflow);
+  BENCH_CALL_LOOP("call", "closure/3+3", closure_call_reg(creg, 4, 5, i));
+  BENCH_CALL_LOOP("call", "closure/8+4",
+                  closure_call_overflow(coverflow, 9, 10, 11, i));
+  free(creg);
+  free(coverflow);
+
+#undef BENCH_CALL_LOOP
+  free(samples);
+}
+
+// Calling one-shot thunks, which includes the cost of them freeing themselves.
+// Comparing against the persistent calls above gives the cost of self-freeing.
+static void bench_call_oneshot(void) {
+  double *const samples = bench_samples(bench_rounds);
+  void *batch[BENCH_BATCH];
+  // Batches take a separate set of now-args for every thunk
+  uint64_t *const args = calloc(BENCH_BATCH * CURRY_MAX_ARGS, sizeof(*args));
+  if (args == NULL) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(1);
+  }
+
+  static const struct {
+    const char *shape;
+    void *fn;
+    size_t now, later;
+  } shapes[] = {
+      {"oneshot/3+3", fn_reg, 3, 3},
+      {"oneshot/8+4", fn_overflow, 8, 4},
+      {"oneshot/256+0", fn_max, CURRY_MAX_ARGS, 0},
+  };
+  for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+    uint64_t call_ns = 0;
+    for (size_t r = 0; r < bench_rounds; r++) {
+      if (!curry_batch(shapes[s].fn, shapes[s].now, shapes[s].later,
+                       args, BENCH_BATCH, batch))
+        bench_check(NULL);
+      const uint64_t t0 = bench_now();
+      for (size_t i = 0; i < BENCH_BATCH; i++) {
+        if (shapes[s].later == 3)
+          bench_sink += ((thunk_reg_t)batch[i])(4, 5, i);
+        else if (shapes[s].later == 4)
+          bench_sink += ((thunk_overflow_t)batch[i])(9, 10, 11, i);
+        else
+          bench_sink += ((thunk_max_t)batch[i])();
+      }
+      const uint64_t dt = bench_now() - t0;
+      samples[r] = (double)dt / BENCH_BATCH;
+      call_ns += dt;
+    }
+    bench_report("call", shapes[s].shape, 1, samples, bench_rounds,
+                 bench_rounds * BENCH_BATCH, call_ns);
+  }
+
+  free(args);
+  free(samples);
+}
+
+// -----------------------------------------------------------------------------
+// Multi-threaded benchmarks. Every thread creates a thunk, calls it, and frees
+// it, as fast as it can. All the threads start at the same time.
+
+typedef struct bench_thread_t {
+  pthread_t thread;
+  pthread_barrier_t *barrier;
+  bool persistent;
+  double *samples;
+} bench_thread_t;
+
+static void *bench_thread(void *arg) {
+  bench_thread_t *const self = arg;
+  uint64_t sink = 0;
+  pthread_barrier_wait(self->barrier);
+  for (size_t r = 0; r < bench_rounds; r++) {
+    const uint64_t t0 = bench_now();
+    for (size_t i = 0; i < BENCH_BATCH; i++) {
+      if (self->persistent) {
+        const thunk_reg_t t = curry_persistent(fn_reg, 3, 3, r, i, 0);
+        bench_check(t);
+        sink += t(4, 5, i);
+        curry_free(t);
+      } else {
+        const thunk_reg_t t = curry(fn_reg, 3, 3, r, i, 0);
+        bench_check(t);
+        sink += t(4, 5, i);
+      }
+    }
+    self->samples[r] = (double)(bench_now() - t0) / BENCH_BATCH;
+  }
+  __atomic_fetch_add(&bench_sink, sink, __ATOMIC_RELAXED);
+  return NULL;
+}
+
+// Run `n` threads at once and report their combined throughput
+static void bench_threads_run(bench_thread_t *threads, double *samples,
+                              size_t n, bool persistent) {
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, n + 1);
+  for (size_t t = 0; t < n; t++) {
+    threads[t].barrier = &barrier;
+    threads[t].persistent = persistent;
+    threads[t].samples = samples + t * bench_rounds;
+    if (pthread_create(&threads[t].thread, NULL, bench_thread, &threads[t]) !=
+        0) {
+      fprintf(stderr, "bench: failed to create thread\n");
+      exit(1);
+    }
+  }
+  // Start the clock before the barrier releases the workers, so none of their
+  // work happens before it
+  const uint64_t start = bench_now();
+  pthread_barrier_wait(&barrier);
+  for (size_t t = 0; t < n; t++)
+    pthread_join(threads[t].thread, NULL);
+  const uint64_t wall = bench_now() - start;
+  pthread_barrier_destroy(&barrier);
+
+  bench_report("cycle", persistent ? "persistent/3+3" : "oneshot/3+3", n,
+               samples, n * bench_rounds, n * bench_rounds * BENCH_BATCH, wall);
+}
+
+static void bench_threads(size_t max_threads) {
+  bench_thread_t *const threads = calloc(max_threads, sizeof(*threads));
+  double *const samples = bench_samples(max_threads * bench_rounds);
+  if (threads == NULL) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(1);
+  }
+
+  for (int persistent = 0; persistent <= 1; persistent++) {
+    // Powers of two, then the largest count even if it isn't one
+    for (size_t n = 1; n < max_threads; n *= 2)
+      bench_threads_run(threads, samples, n, persistent);
+    bench_threads_run(threads, samples, max_threads, persistent);
+  }
+
+  free(samples);
+  free(threads);
+}
+
+// -----------------------------------------------------------------------------
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-r rounds] [-t max_threads] [-s] [-p pages]\n"
+          "  -r  samples per benchmark, each of %d operations (default %d)\n"
+          "  -t  largest thread count to measure (default %d)\n"
+          "  -s  set CURRY_OPTION_SHARED_CODE\n"
+          "  -p  set CURRY_OPTION_HUGE_PAGES (0 small, 1 THP, 2 hugetlb)\n",
+          argv0, BENCH_BATCH, BENCH_DEFAULT_ROUNDS, BENCH_DEFAULT_THREADS);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  size_t max_threads = BENCH_DEFAULT_THREADS;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:t:sp:")) != -1) {
+    switch (opt) {
+    case 'r':
+      bench_rounds = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      max_threads = strtoull(optarg, NULL, 0);
+      break;
+    case 's':
+      if (!curry_set_option(CURRY_OPTION_SHARED_CODE, 1))
+        usage(argv[0]);
+      break;
+    case 'p':
+      if (!curry_set_option(CURRY_OPTION_HUGE_PAGES,
+                            strtoull(optarg, NULL, 0)))
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (bench_rounds == 0 || max_threads == 0)
+    usage(argv[0]);
+
+  printf("bench\tshape\tthreads\tsamples\tmean_ns\tp50_ns\tp90_ns\tp99_ns\t"
+         "max_ns\tmops\n");
+  bench_create();
+  bench_call();
+  bench_call_oneshot();
+  bench_threads(max_threads);
+
+  // Huge pages fall back silently, so say what we actually measured
+  static const char *const page_modes[] = {
+      [CURRY_PAGES_SMALL] = "small",
+      [CURRY_PAGES_TRANSPARENT] = "transparent huge",
+      [CURRY_PAGES_HUGETLB] = "hugetlb",
+  };
+  fprintf(stderr, "bench: thunk memory backed by %s pages\n",
+          page_modes[curry_page_mode()]);
+  // Keep the results of every call alive without depending on their value
+  __asm__ volatile("" : : "r"(bench_sink));
+  return 0;
+}
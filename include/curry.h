@@ -3,15 +3,23 @@
  * \brief Library to curry C functions
  *
  * This library assumes that all arguments are `uint64_t`, and it assumes that
- * the function returns in %rax. It allows the user to pass the first few
- * arguments and receive a function pointer that can be used on the remaining
- * arguments. That function pointer is dynamically allocated, and it is freed
- * just before it returns.
+ * the function returns in %rax, unless the argument classes are given with
+ * `vcurry_typed`. It allows the user to pass the first few arguments and
+ * receive a function pointer that can be used on the remaining arguments. That
+ * function pointer is dynamically allocated. By default, it is freed just
+ * before it returns, so it can only be called once. Persistent thunks can be
+ * called any number of times, and are freed with `curry_free`.
  */
 #pragma once
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * \brief Variadic version of `vcurry`
@@ -38,15 +46,696 @@ void *curry(void *fn, size_t nargs_now, size_t nargs_later, ...);
  */
 void *vcurry(void *fn, size_t nargs_now, size_t nargs_later, va_list args_now);
 
+/**
+ * \brief Variadic version of `vcurry_persistent`
+ * \see vcurry_persistent
+ */
+void *curry_persistent(void *fn, size_t nargs_now, size_t nargs_later, ...);
+
+/**
+ * \brief Curries a function, returning a thunk that can be called many times
+ *
+ * This is like `vcurry`, except the returned thunk doesn't free itself when it
+ * returns. It can be called any number of times, from any number of threads,
+ * until it is released with `curry_free`. The thunk also doesn't have to do
+ * any work to free itself, so calls through it are cheaper.
+ *
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of arguments passed via `args_now`
+ * \param [in] nargs_later The number of arguments that will be passed when the
+ * returned function pointer is called
+ * \param [in] args_now The arguments to be remembered on the returned function
+ * \return A function pointer, or `NULL` on failure
+ * \see vcurry
+ * \see curry_free
+ */
+void *vcurry_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                        va_list args_now);
+
+/**
+ * \brief Curries a function, with the arguments given as an array
+ *
+ * This is like `vcurry`, but it doesn't need a `va_list`.
+ *
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of elements in `args_now`
+ * \param [in] nargs_later The number of arguments that will be passed when the
+ * returned function pointer is called
+ * \param [in] args_now The arguments to be remembered on the returned function
+ * \return A function pointer, or `NULL` on failure
+ * \see vcurry
+ */
+void *curry_array(void *fn, size_t nargs_now, size_t nargs_later,
+                  const uint64_t *args_now);
+
+/**
+ * \brief Array version of `vcurry_persistent`
+ * \see curry_array
+ * \see vcurry_persistent
+ */
+void *curry_array_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                             const uint64_t *args_now);
+
+/**
+ * \brief Curries a function many times with different arguments
+ *
+ * This creates `count` thunks for the same function and shape. The arguments
+ * for the `i`-th thunk are `args[i * nargs_now]` through
+ * `args[i * nargs_now + nargs_now - 1]`. Creating thunks in bulk is cheaper
+ * than creating them one at a time.
+ *
+ * Either all the thunks are created, or none of them are.
+ *
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of arguments to remember on each thunk
+ * \param [in] nargs_later The number of arguments that will be passed when
+ * each returned function pointer is called
+ * \param [in] args The arguments for all the thunks, back to back
+ * \param [in] count The number of thunks to create
+ * \param [out] out Where to write the `count` function pointers
+ * \return Whether the thunks were created
+ * \see curry_array
+ */
+bool curry_batch(void *fn, size_t nargs_now, size_t nargs_later,
+                 const uint64_t *args, size_t count, void **out);
+
+/**
+ * \brief Batch version of `vcurry_persistent`
+ * \see curry_batch
+ * \see vcurry_persistent
+ */
+bool curry_batch_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                            const uint64_t *args, size_t count, void **out);
+
+/**
+ * \brief How an argument is passed
+ * \see vcurry_typed
+ */
+typedef enum curry_arg_class_t {
+  /** \brief An integer or pointer, passed in a general-purpose register */
+  CURRY_ARG_INTEGER,
+  /** \brief A `double`, passed in an XMM register */
+  CURRY_ARG_DOUBLE,
+  /** \brief A `float`, passed in an XMM register */
+  CURRY_ARG_FLOAT,
+} curry_arg_class_t;
+
+/**
+ * \brief Variadic version of `vcurry_typed`
+ * \see vcurry_typed
+ */
+void *curry_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                  const curry_arg_class_t *classes, ...);
+
+/**
+ * \brief Curries a function that takes floating-point arguments
+ *
+ * This is like `vcurry`, except each argument can be a `double` or a `float`
+ * as well as an integer. The thunk passes each argument where the SysV ABI
+ * says it goes, so bound floating-point arguments are loaded straight into XMM
+ * registers, and later ones are moved between them. Floating-point arguments
+ * are read out of `args_now` as `double`, which is what a `float` is promoted
+ * to when it's passed through `...`. The thunk leaves the return value in
+ * both %rax and %xmm0 intact, so the function can return either.
+ *
+ * Thunks with floating-point arguments always get their own code, so they
+ * aren't affected by `CURRY_OPTION_SHARED_CODE` or `CURRY_OPTION_INTERN`, and
+ * they're never fused with other thunks. If every argument is an integer, this
+ * is the same as `vcurry`. With `CURRY_OPTION_REBINDABLE`, floating-point
+ * arguments are rebound by passing their bits to `curry_rebind`.
+ *
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of arguments passed via `args_now`
+ * \param [in] nargs_later The number of arguments that will be passed when the
+ * returned function pointer is called
+ * \param [in] classes The class of each of the `nargs_now + nargs_later`
+ * arguments, with the now-args first
+ * \param [in] args_now The arguments to be remembered on the returned function
+ * \return A function pointer, or `NULL` on failure or if a class is invalid
+ * \see vcurry
+ */
+void *vcurry_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                   const curry_arg_class_t *classes, va_list args_now);
+
+/**
+ * \brief Variadic version of `vcurry_typed_persistent`
+ * \see vcurry_typed_persistent
+ */
+void *curry_typed_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                             const curry_arg_class_t *classes, ...);
+
+/**
+ * \brief Persistent version of `vcurry_typed`
+ * \see vcurry_typed
+ * \see vcurry_persistent
+ */
+void *vcurry_typed_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                              const curry_arg_class_t *classes,
+                              va_list args_now);
+
+/**
+ * \brief Curries a function that takes floating-point arguments, with the
+ * arguments given as an array
+ *
+ * This is like `vcurry_typed`, but it doesn't need a `va_list`. Each argument
+ * is given as its bits. A `double` takes the whole element, and a `float`
+ * takes the low 32 bits.
+ *
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of elements in `args_now`
+ * \param [in] nargs_later The number of arguments that will be passed when the
+ * returned function pointer is called
+ * \param [in] classes The class of each of the `nargs_now + nargs_later`
+ * arguments, with the now-args first
+ * \param [in] args_now The arguments to be remembered on the returned function
+ * \return A function pointer, or `NULL` on failure or if a class is invalid
+ * \see vcurry_typed
+ * \see curry_array
+ */
+void *curry_array_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                        const curry_arg_class_t *classes,
+                        const uint64_t *args_now);
+
+/**
+ * \brief Persistent version of `curry_array_typed`
+ * \see curry_array_typed
+ * \see vcurry_persistent
+ */
+void *curry_array_typed_persistent(void *fn, size_t nargs_now,
+                                   size_t nargs_later,
+                                   const curry_arg_class_t *classes,
+                                   const uint64_t *args_now);
+
+/**
+ * \brief Frees a thunk without calling it
+ *
+ * This is how persistent thunks are released. It can also be used to discard a
+ * thunk from `vcurry` that will never be called. It's safe to pass `NULL`, or
+ * a function that was returned as-is because `nargs_now` was zero.
+ *
+ * The thunk must not be running, and it must not be called afterwards. With
+ * `CURRY_OPTION_INTERN`, the same thunk might have been returned many times.
+ * Each of those has to be freed, and the thunk can still be called until the
+ * last one is.
+ *
+ * \param [in] thunk The thunk to free
+ * \see vcurry_persistent
+ */
+void curry_free(void *thunk);
+
+/**
+ * \brief Changes one of a thunk's bound arguments
+ *
+ * This only works on persistent thunks created with `CURRY_OPTION_REBINDABLE`.
+ * No code is regenerated. The change is a single store, so a call running at
+ * the same time on another thread sees either the old value or the new one,
+ * and never a mix.
+ *
+ * \param [in] thunk The thunk to change
+ * \param [in] idx Which of the thunk's `nargs_now` arguments to change
+ * \param [in] value The new value of the argument
+ * \return Whether the thunk is rebindable and has that argument
+ */
+bool curry_rebind(void *thunk, size_t idx, uint64_t value);
+
+/**
+ * \brief Composes two functions into one thunk
+ *
+ * This is the same as a pipeline of `f` followed by `g`. The returned thunk
+ * takes `nargs_later` arguments, calls `f` with them, and then calls `g` with
+ * the result.
+ *
+ * \param [in] g The function to call second
+ * \param [in] f The function to call first
+ * \param [in] nargs_later The number of arguments `f` takes
+ * \return A persistent thunk, or `NULL` on failure
+ * \see curry_pipeline
+ */
+void *curry_compose(void *g, void *f, size_t nargs_later);
+
+/**
+ * \brief Chains functions into one thunk
+ *
+ * The returned thunk takes `nargs_later` arguments and passes them to the first
+ * stage. The result of each stage is passed as the last argument to the next,
+ * and the result of the last stage is returned. All of this happens in one
+ * thunk, and the last stage is usually jumped to rather than called.
+ *
+ * A stage that is a persistent thunk of ours is skipped entirely. Its function
+ * is called directly, with its now-args followed by the argument for that
+ * stage. So, `curry_persistent(g, 2, 1, a, b)` as a stage calls `g(a, b, x)`
+ * with the result `x` of the stage before. Its arguments are copied, so it can
+ * be freed right away. Otherwise, the first stage takes `nargs_later`
+ * arguments, and every other stage takes one. Stages must not be one-shot
+ * thunks, since they'd be called every time the pipeline is.
+ *
+ * The returned thunk is persistent, and it's released with `curry_free`. It
+ * isn't shared or profiled, and it can't be rebound. If there's only one stage,
+ * it's returned as-is.
+ *
+ * \param [in] stages The functions to call, in order
+ * \param [in] nstages The number of stages
+ * \param [in] nargs_later The number of arguments the first stage takes
+ * \return A persistent thunk, or `NULL` on failure
+ */
+void *curry_pipeline(void *const *stages, size_t nstages, size_t nargs_later);
+
+/**
+ * \brief Calls a function once for each row of arguments
+ *
+ * This is the same as currying `fn` with `args_now`, and then calling the thunk
+ * with each of the `nrows` rows in `rows`, but without a thunk in between.
+ * Instead, a loop is generated for the batch, which calls `fn` directly. The
+ * now-args are built into the loop, and each row is loaded straight into the
+ * argument registers. If `fn` is a persistent thunk of ours, its function is
+ * called directly too, with its now-args first.
+ *
+ * The rows are stored one after the other, each with `nargs_later` arguments.
+ * Rows and results are accessed in order, and `fn` may change rows it hasn't
+ * been called with yet. `fn` must not be a one-shot thunk, since it's called
+ * once per row.
+ *
+ * \param [in] fn The function to call
+ * \param [in] nargs_now The number of arguments in `args_now`
+ * \param [in] nargs_later The number of arguments in each row
+ * \param [in] args_now The arguments passed first on every call
+ * \param [in] rows The rest of the arguments for each call
+ * \param [in] nrows The number of calls to make
+ * \param [out] results Where to write each call's return value, or `NULL` to
+ * discard them
+ * \return Whether the calls were made
+ */
+bool curry_apply_many(void *fn, size_t nargs_now, size_t nargs_later,
+                      const uint64_t *args_now, const uint64_t *rows,
+                      size_t nrows, uint64_t *results);
+
+/**
+ * \brief A group of thunks that are all freed at once
+ * \see curry_region_create
+ */
+typedef struct curry_region_t curry_region_t;
+
+/**
+ * \brief Creates a region for thunks
+ *
+ * Thunks created in a region are packed one after the other into memory the
+ * region owns, and they're all freed together by `curry_region_destroy`. That
+ * makes creating them about as cheap as bumping a pointer, and freeing them
+ * costs nothing per thunk. This suits thunks that all live as long as
+ * something else, like a request.
+ *
+ * A region can only be used by one thread at a time, but its thunks can be
+ * called from anywhere.
+ *
+ * \return The new region, or `NULL` on failure
+ * \see vcurry_in_region
+ */
+curry_region_t *curry_region_create(void);
+
+/**
+ * \brief Frees a region and every thunk in it
+ *
+ * None of the region's thunks can be running, and none of them can be called
+ * afterwards. It's safe to pass `NULL`.
+ *
+ * \param [in] region The region to free
+ */
+void curry_region_destroy(curry_region_t *region);
+
+/**
+ * \brief Variadic version of `vcurry_in_region`
+ * \see vcurry_in_region
+ */
+void *curry_in_region(curry_region_t *region, void *fn, size_t nargs_now,
+                      size_t nargs_later, ...);
+
+/**
+ * \brief Curries a function into a region
+ *
+ * This is like `vcurry_persistent`, except the thunk is freed along with the
+ * region. It can be called any number of times until then. `curry_free` does
+ * nothing to it.
+ *
+ * Thunks in a region always get their own code, so they aren't affected by
+ * `CURRY_OPTION_SHARED_CODE`, `CURRY_OPTION_INTERN`, or
+ * `CURRY_OPTION_REBINDABLE`. Currying one of them again calls it, rather than
+ * fusing with it.
+ *
+ * \param [in] region The region to create the thunk in
+ * \param [in] fn The function to curry
+ * \param [in] nargs_now The number of arguments passed via `args_now`
+ * \param [in] nargs_later The number of arguments that will be passed when the
+ * returned function pointer is called
+ * \param [in] args_now The arguments to be remembered on the returned function
+ * \return A function pointer, or `NULL` on failure
+ * \see vcurry_persistent
+ */
+void *vcurry_in_region(curry_region_t *region, void *fn, size_t nargs_now,
+                       size_t nargs_later, va_list args_now);
+
+/**
+ * \brief Makes room for thunks ahead of time
+ *
+ * This maps and faults in enough memory for `nthunks` thunks of every size that
+ * a thunk taking at most `max_args` arguments in total could need. Until
+ * `curry_trim` is called, that memory is kept even when it's unused, so
+ * creating up to that many thunks doesn't need to map memory or take page
+ * faults. Some bookkeeping can still allocate, such as the first thunk a
+ * thread creates, the first thunk of each shape with
+ * `CURRY_OPTION_SHARED_CODE`, and each thunk added with `CURRY_OPTION_INTERN`.
+ * Thunks from `vcurry_typed` with floating-point arguments can be a little
+ * bigger than this accounts for.
+ *
+ * Reservations are per size, and they don't add up. Reserving again with a
+ * larger `nthunks` grows the reservation to that.
+ *
+ * \param [in] nthunks The number of thunks to make room for
+ * \param [in] max_args The most arguments any of the thunks will take
+ * \return Whether all of the room could be made
+ * \see curry_trim
+ */
+bool curry_reserve(size_t nthunks, size_t max_args);
+
+/**
+ * \brief Gives unused thunk memory back to the system
+ *
+ * This drops any reservations from `curry_reserve`, and returns the memory of
+ * everything that isn't in use, including memory kept from destroyed regions.
+ * Free memory cached by other threads stays mapped until those threads give it
+ * up.
+ *
+ * \see curry_reserve
+ */
+void curry_trim(void);
+
+/**
+ * \brief Options that change how thunks are created
+ *
+ * Options apply to the whole process, and they only affect thunks created after
+ * they are set. Unless noted otherwise, options default to zero.
+ *
+ * \see curry_set_option
+ */
+typedef enum curry_option_t {
+  /**
+   * \brief Share code between thunks of the same shape
+   *
+   * When this is one, the code to shuffle the arguments is generated once for
+   * each combination of `nargs_now` and `nargs_later`. Each thunk is then just
+   * a fixed stub that jumps to that code, and a record holding the function and
+   * the arguments. Creating a thunk doesn't generate any code, and thunks take
+   * up less space, but calls have to load the arguments from memory.
+   */
+  CURRY_OPTION_SHARED_CODE,
+  /**
+   * \brief Maximum bytes of free thunk memory each thread may cache
+   *
+   * Each thread keeps some free thunk memory to itself, so that creating and
+   * freeing thunks doesn't contend with other threads. This bounds how much
+   * memory each thread holds on to. Setting it to zero disables the cache. The
+   * default is 64 KiB.
+   */
+  CURRY_OPTION_THREAD_CACHE,
+  /**
+   * \brief Share persistent thunks that do the same thing
+   *
+   * When this is one, creating a persistent thunk with the same function,
+   * arguments, and `nargs_later` as one that's still live returns that thunk
+   * instead of making a new one. Each time a thunk is returned, it has to be
+   * released with `curry_free`, and it's only actually freed once all of them
+   * have been. One-shot thunks are never shared, since they free themselves.
+   */
+  CURRY_OPTION_INTERN,
+  /**
+   * \brief The kind of pages to back new thunk memory with
+   *
+   * This is a `curry_page_mode_t`. Thunk memory is mapped 2 MiB at a time, so
+   * with huge pages, each of those takes up a single TLB entry. If the kind of
+   * page asked for isn't available, smaller ones are used instead. Check
+   * `curry_page_mode` to see what was actually used.
+   */
+  CURRY_OPTION_HUGE_PAGES,
+  /**
+   * \brief Let persistent thunks' bound arguments be changed
+   *
+   * When this is one, persistent thunks load all of their now-args from memory
+   * instead of having them built into their code, so `curry_rebind` can change
+   * them. They're never shared by `CURRY_OPTION_INTERN`, and currying one
+   * makes a thunk that calls it, so changes to it are seen through the new
+   * thunk too.
+   */
+  CURRY_OPTION_REBINDABLE,
+  /**
+   * \brief Count how often thunks are called, and how long they take
+   *
+   * This is a `curry_profile_mode_t`. Thunks created while it's set count
+   * their calls, and optionally the cycles spent in them, in counters shared by
+   * every thunk with the same function and shape. Read them with
+   * `curry_profile_dump`. Each thunk needs its own code to update its counters,
+   * so this takes precedence over `CURRY_OPTION_SHARED_CODE`.
+   */
+  CURRY_OPTION_PROFILE,
+  /**
+   * \brief List thunks in a perf map, so profilers can name them
+   *
+   * When this is one, thunks and shared code created afterwards are listed in
+   * `/tmp/perf-<pid>.map`. Each thunk is named after the function it calls,
+   * like `curry_thunk<fn,now=3,later=2>`. Functions without a dynamic symbol
+   * are named by their address. Entries are buffered, and written when the
+   * buffer fills up, when the process exits, or on `curry_perf_map_flush`.
+   */
+  CURRY_OPTION_PERF_MAP,
+  /** \brief The number of options */
+  CURRY_OPTION_COUNT,
+} curry_option_t;
+
+/**
+ * \brief Sets an option
+ * \param [in] option The option to set
+ * \param [in] value The new value for the option
+ * \return Whether the option exists and the value is valid for it
+ */
+bool curry_set_option(curry_option_t option, uint64_t value);
+
+/**
+ * \brief Gets the current value of an option
+ * \param [in] option The option to get
+ * \return The option's value, or zero if it doesn't exist
+ */
+uint64_t curry_get_option(curry_option_t option);
+
+/**
+ * \brief Kinds of pages that thunk memory can be backed by
+ * \see CURRY_OPTION_HUGE_PAGES
+ */
+typedef enum curry_page_mode_t {
+  /** \brief Normal pages */
+  CURRY_PAGES_SMALL,
+  /**
+   * \brief Transparent huge pages
+   *
+   * The kernel is asked to use huge pages, but it might not always be able to
+   * find one.
+   */
+  CURRY_PAGES_TRANSPARENT,
+  /** \brief Huge pages from the pool the system has reserved for them */
+  CURRY_PAGES_HUGETLB,
+} curry_page_mode_t;
+
+/**
+ * \brief Gets the kind of pages the most recently mapped thunk memory got
+ *
+ * Memory is only mapped when the memory already mapped runs out. So, this
+ * doesn't change right after `CURRY_OPTION_HUGE_PAGES` is set.
+ *
+ * \return The kind of pages, or `CURRY_PAGES_SMALL` if no memory was mapped
+ */
+curry_page_mode_t curry_page_mode(void);
+
+/**
+ * \brief What profiled thunks keep track of
+ * \see CURRY_OPTION_PROFILE
+ */
+typedef enum curry_profile_mode_t {
+  /** \brief Thunks aren't profiled, and their code is unchanged */
+  CURRY_PROFILE_OFF,
+  /** \brief Thunks count their calls */
+  CURRY_PROFILE_CALLS,
+  /**
+   * \brief Thunks count their calls, and the cycles spent in them
+   *
+   * Cycles are measured with `rdtsc` around the call to the function, so they
+   * count time stamp counter ticks, including any time spent in other threads
+   * if this one is descheduled. This needs a stack frame, so thunks that could
+   * otherwise jump straight to their function make a call instead.
+   */
+  CURRY_PROFILE_CYCLES,
+} curry_profile_mode_t;
+
+/**
+ * \brief Counters for the thunks with one function and shape
+ * \see curry_profile_dump
+ */
+typedef struct curry_profile_t {
+  /** \brief The function the thunks call */
+  void *fn;
+  /** \brief The number of arguments the thunks bind */
+  size_t nargs_now;
+  /** \brief The number of arguments the thunks take */
+  size_t nargs_later;
+  /** \brief The number of times the thunks were called */
+  uint64_t calls;
+  /**
+   * \brief Time stamp counter ticks spent in the function
+   *
+   * This only includes calls to thunks created with `CURRY_PROFILE_CYCLES`.
+   */
+  uint64_t cycles;
+} curry_profile_t;
+
+/**
+ * \brief Gets the counters of profiled thunks
+ *
+ * There's one entry for each combination of function, `nargs_now`, and
+ * `nargs_later` that a profiled thunk was ever created with. Thunks that were
+ * fused with the thunk they curried are counted under the function they
+ * actually call, with all the arguments they bind. Counters aren't reset when
+ * thunks are freed.
+ *
+ * \param [out] entries Where to write the entries
+ * \param [in] max The most entries to write
+ * \return The total number of entries, which might be more than `max`
+ */
+size_t curry_profile_dump(curry_profile_t *entries, size_t max);
+
+/**
+ * \brief Sets the counters of every profiled thunk back to zero
+ *
+ * Calls that are running at the same time might be counted either way.
+ */
+void curry_profile_reset(void);
+
+/**
+ * \brief Writes out any buffered perf map entries
+ *
+ * Call this before a profiler reads the map while the process is still
+ * running, or before the process exits without running `atexit` handlers.
+ *
+ * \see CURRY_OPTION_PERF_MAP
+ */
+void curry_perf_map_flush(void);
+
+/**
+ * \brief How thunks are generated on this machine
+ * \see curry_codegen_info
+ */
+typedef struct curry_codegen_info_t {
+  /**
+   * \brief Whether thunks start with `endbr64`
+   *
+   * This is only needed if the CPU supports indirect branch tracking and the
+   * kernel might have turned it on. Otherwise, it's left out.
+   */
+  bool endbr;
+  /**
+   * \brief Whether long runs of arguments are copied with AVX
+   *
+   * If so, they're copied 32 bytes at a time through %ymm15, which isn't used
+   * for arguments. Otherwise, they're copied 8 bytes at a time.
+   */
+  bool avx_copy;
+} curry_codegen_info_t;
+
+/**
+ * \brief Gets the choices made when generating code for this machine
+ *
+ * The CPU and kernel are checked once, before the first thunk is created, and
+ * every thunk is generated the same way after that. Regardless of the machine,
+ * frames are set up with `push`, `mov`, and `sub`, since `enter` is microcoded
+ * and slow everywhere.
+ *
+ * \param [out] info Where to write the choices
+ */
+void curry_codegen_info(curry_codegen_info_t *info);
+
+/**
+ * \brief Reasons creating a thunk can fail
+ * \see curry_stats_t
+ */
+typedef enum curry_failure_t {
+  /** \brief `nargs_now` and `nargs_later` add up to more than the maximum */
+  CURRY_FAILURE_TOO_MANY_ARGS,
+  /** \brief Memory for the thunk couldn't be allocated or mapped */
+  CURRY_FAILURE_NO_MEMORY,
+  /** \brief The number of reasons */
+  CURRY_FAILURE_COUNT,
+} curry_failure_t;
+
+/**
+ * \brief Number of buckets in the histogram of thunk sizes
+ * \see curry_stats_t
+ */
+#define CURRY_STATS_SIZE_BUCKETS (8)
+
+/**
+ * \brief Statistics about thunks over the life of the process
+ *
+ * Functions returned as-is because `nargs_now` was zero aren't thunks, so they
+ * aren't counted.
+ *
+ * \see curry_stats
+ */
+typedef struct curry_stats_t {
+  /** \brief The number of thunks that have been created but not freed */
+  uint64_t live;
+  /** \brief The number of thunks ever created */
+  uint64_t created;
+  /** \brief The number of thunks ever freed, whether by being called or not */
+  uint64_t freed;
+  /** \brief The number of bytes of executable memory taken up by live thunks */
+  uint64_t bytes_used;
+  /**
+   * \brief The number of bytes of executable memory backed by the system
+   *
+   * Besides the memory in `bytes_used`, this includes memory that's free but
+   * being held on to for future thunks, and code shared between thunks.
+   */
+  uint64_t bytes_mapped;
+  /** \brief The number of calls that failed, by reason */
+  uint64_t failures[CURRY_FAILURE_COUNT];
+  /**
+   * \brief Histogram of the sizes of thunks ever created
+   *
+   * Bucket `i` counts thunks that took up more than `32 << i` bytes, but at
+   * most `64 << i` bytes.
+   */
+  uint64_t sizes[CURRY_STATS_SIZE_BUCKETS];
+} curry_stats_t;
+
+/**
+ * \brief Gets statistics about thunks
+ *
+ * Statistics are collected per thread and only added up here, so keeping them
+ * is cheap, but calling this is not. Threads can create and free thunks while
+ * this runs, so the results aren't a perfectly consistent snapshot.
+ *
+ * \param [out] stats Where to write the statistics
+ */
+void curry_stats(curry_stats_t *stats);
+
 /**
  * \brief Maximum number of arguments that can be curried
  *
  * This limit is cumulative and not individual - the sum of `nargs_now`` and
  * `nargs_later` cannot exceed this. This bound can go higher if needed. It's
- * bottlenecked by the stack space we can allocate with `enter`, and it's
- * limited by the 32-bit offsets we can encode in `mov`.
+ * bottlenecked by the largest slot a thunk can be put in, and it's limited by
+ * the 32-bit offsets we can encode in `mov`.
  *
  * \see curry
  * \see vcurry
  */
 #define CURRY_MAX_ARGS (256)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,193 @@
+/**
+ * \file curry.hpp
+ * \brief Typed C++ interface to the currying library
+ *
+ * `curry_cpp::bind<&fn>(args...)` binds the first few arguments of `fn`, and
+ * returns a `curry_cpp::thunk` that takes the rest. How many arguments go on
+ * each side is worked out at compile time from the type of `fn`, so it can't
+ * disagree with the function. The thunk is persistent, and it's freed when the
+ * `curry_cpp::thunk` that owns it is destroyed. The namespace isn't `curry`,
+ * since that would clash with the C function of the same name.
+ *
+ * Thunks move arguments around eight bytes at a time, through registers and
+ * the stack. So, every parameter of `fn` has to be an integer, enumeration,
+ * pointer, `float`, or `double`, and `fn` has to return one of those, another
+ * floating-point type, or nothing. Anything else is rejected at compile time.
+ * Bound arguments are converted to the parameter types just like they would be
+ * in a call.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "curry.h"
+
+namespace curry_cpp {
+
+/**
+ * \brief A thunk, and the responsibility to free it
+ *
+ * This is like `std::unique_ptr` for thunks. It can be empty, either because it
+ * was moved from or because the thunk couldn't be created.
+ *
+ * \tparam Signature The type of the thunk, as a function type
+ */
+template <typename Signature> class thunk;
+
+template <typename R, typename... Args> class thunk<R(Args...)> {
+public:
+  /** \brief The type of the thunk's function pointer */
+  using pointer = R (*)(Args...);
+
+  thunk() noexcept = default;
+  /** \brief Take ownership of a thunk, which may be `nullptr` */
+  explicit thunk(pointer fn) noexcept : fn_(fn) {}
+  thunk(thunk &&other) noexcept : fn_(other.release()) {}
+  thunk &operator=(thunk &&other) noexcept {
+    reset(other.release());
+    return *this;
+  }
+  thunk(const thunk &) = delete;
+  thunk &operator=(const thunk &) = delete;
+  ~thunk() { reset(); }
+
+  /** \brief Call the thunk with the rest of the arguments */
+  R operator()(Args... args) const { return fn_(args...); }
+
+  /** \brief Get the thunk's function pointer, keeping ownership of it */
+  pointer get() const noexcept { return fn_; }
+  /** \brief Give up ownership of the thunk, which must then be freed with
+   * `curry_free` */
+  pointer release() noexcept { return std::exchange(fn_, nullptr); }
+  /** \brief Free the current thunk, if any, and take ownership of another */
+  void reset(pointer fn = nullptr) noexcept {
+    curry_free(reinterpret_cast<void *>(std::exchange(fn_, fn)));
+  }
+  /** \brief Whether there's a thunk */
+  explicit operator bool() const noexcept { return fn_ != nullptr; }
+
+private:
+  pointer fn_ = nullptr;
+};
+
+namespace detail {
+
+// Whether values of a type are passed in a single general-purpose register, or
+// a single slot on the stack
+template <typename T>
+inline constexpr bool is_word_v =
+    (std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>) &&
+    sizeof(T) <= sizeof(std::uint64_t);
+
+// Whether values of a type are passed in the low half of an XMM register
+template <typename T>
+inline constexpr bool is_sse_v =
+    std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+// Whether values of a type are returned in registers that thunks pass through
+// untouched. Anything returned in memory would need a hidden argument.
+template <typename T>
+inline constexpr bool is_return_v =
+    std::is_void_v<T> || is_word_v<T> || std::is_floating_point_v<T>;
+
+// How the thunk should pass a parameter of a type
+template <typename T> constexpr curry_arg_class_t class_of() {
+  if constexpr (std::is_same_v<T, float>)
+    return CURRY_ARG_FLOAT;
+  else if constexpr (std::is_same_v<T, double>)
+    return CURRY_ARG_DOUBLE;
+  else
+    return CURRY_ARG_INTEGER;
+}
+
+// Pull apart the type of a function pointer. Variadic functions don't match,
+// since we can't know how many arguments they take.
+template <typename F> struct signature;
+template <typename R, typename... Args> struct signature<R (*)(Args...)> {
+  using result = R;
+  using params = std::tuple<Args...>;
+  static constexpr std::size_t arity = sizeof...(Args);
+  static constexpr bool valid =
+      is_return_v<R> && ((is_word_v<Args> || is_sse_v<Args>) && ...);
+  static constexpr std::array<curry_arg_class_t, arity> classes = {
+      class_of<Args>()...};
+};
+template <typename R, typename... Args>
+struct signature<R (*)(Args...) noexcept> : signature<R (*)(Args...)> {};
+
+// The type of thunk left after binding the first `N` parameters
+template <typename Sig, std::size_t N, typename Seq> struct rest;
+template <typename Sig, std::size_t N, std::size_t... I>
+struct rest<Sig, N, std::index_sequence<I...>> {
+  using type = thunk<typename Sig::result(
+      std::tuple_element_t<N + I, typename Sig::params>...)>;
+};
+
+// Convert a bound argument the way a call would, then to the word that
+// `curry_array_typed_persistent` expects for it. Floating-point values are
+// passed as their bits. The parameter type is given explicitly, so it's not
+// deduced.
+template <typename T> std::uint64_t to_word(T value) {
+  if constexpr (std::is_same_v<T, float>) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(value));
+    return bits;
+  } else if constexpr (std::is_same_v<T, double>) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(value));
+    return bits;
+  } else if constexpr (std::is_pointer_v<T>) {
+    return reinterpret_cast<std::uintptr_t>(value);
+  } else if constexpr (std::is_enum_v<T>) {
+    return static_cast<std::uint64_t>(
+        static_cast<std::underlying_type_t<T>>(value));
+  } else {
+    return static_cast<std::uint64_t>(value);
+  }
+}
+
+template <auto Fn, typename Sig, typename Result, std::size_t... I,
+          typename... Bound>
+Result bind(std::index_sequence<I...>, Bound &&...bound) {
+  constexpr std::size_t nargs_now = sizeof...(Bound);
+  const std::array<std::uint64_t, nargs_now> args = {
+      to_word<std::tuple_element_t<I, typename Sig::params>>(
+          std::forward<Bound>(bound))...};
+  void *const ret = curry_array_typed_persistent(
+      reinterpret_cast<void *>(Fn), nargs_now, Sig::arity - nargs_now,
+      Sig::classes.data(), args.data());
+  return Result(reinterpret_cast<typename Result::pointer>(ret));
+}
+
+} // namespace detail
+
+/**
+ * \brief Curries a function, returning a persistent thunk that owns itself
+ *
+ * The arguments bound here are the first parameters of `Fn`, and the thunk
+ * takes the rest. If the thunk couldn't be created, the result is empty.
+ *
+ * \tparam Fn The function to curry
+ * \param [in] bound The arguments to bind
+ * \return The thunk, or an empty thunk on failure
+ */
+template <auto Fn, typename... Bound> auto bind(Bound &&...bound) {
+  using sig = detail::signature<std::decay_t<decltype(Fn)>>;
+  static_assert(sig::valid,
+                "Thunks can only pass integers, pointers, and floats");
+  static_assert(sizeof...(Bound) <= sig::arity, "Too many arguments bound");
+  static_assert(sig::arity <= CURRY_MAX_ARGS, "Too many parameters");
+  constexpr std::size_t nargs_now = sizeof...(Bound);
+  using result = typename detail::rest<
+      sig, nargs_now, std::make_index_sequence<sig::arity - nargs_now>>::type;
+  return detail::bind<Fn, sig, result>(std::make_index_sequence<nargs_now>(),
+                                       std::forward<Bound>(bound)...);
+}
+
+} // namespace curry_cpp
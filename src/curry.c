@@ -1,11 +1,20 @@
 #include "curry.h"
+#include "curry_cpu.h"
+#include "curry_intern.h"
+#include "curry_perf.h"
+#include "curry_profile.h"
+#include "curry_region.h"
+#include "curry_slab.h"
+#include "curry_stats.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Utility functions for determining the size of an argument
 static bool is_u32(uint64_t x) {
@@ -27,48 +36,933 @@ void *curry(void *fn, size_t nargs_now, size_t nargs_later, ...) {
   return ret;
 }
 
+void *curry_persistent(void *fn, size_t nargs_now, size_t nargs_later, ...) {
+  // Same as `curry`
+  va_list args_now;
+  va_start(args_now, nargs_later);
+  void *const ret = vcurry_persistent(fn, nargs_now, nargs_later, args_now);
+  va_end(args_now);
+  return ret;
+}
+
+void *curry_in_region(curry_region_t *region, void *fn, size_t nargs_now,
+                      size_t nargs_later, ...) {
+  // Same as `curry`
+  va_list args_now;
+  va_start(args_now, nargs_later);
+  void *const ret =
+      vcurry_in_region(region, fn, nargs_now, nargs_later, args_now);
+  va_end(args_now);
+  return ret;
+}
+
+void *curry_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                  const curry_arg_class_t *classes, ...) {
+  // Same as `curry`
+  va_list args_now;
+  va_start(args_now, classes);
+  void *const ret =
+      vcurry_typed(fn, nargs_now, nargs_later, classes, args_now);
+  va_end(args_now);
+  return ret;
+}
+
+void *curry_typed_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                             const curry_arg_class_t *classes, ...) {
+  // Same as `curry`
+  va_list args_now;
+  va_start(args_now, classes);
+  void *const ret =
+      vcurry_typed_persistent(fn, nargs_now, nargs_later, classes, args_now);
+  va_end(args_now);
+  return ret;
+}
+
+// Code is emitted through one of these. If `buf` is `NULL`, nothing is written,
+// but `pos` still advances. That's how thunks are sized before they're
+// allocated. Both passes run the same code, so they always agree on how every
+// instruction is encoded, and the size is exact.
+typedef struct emitter_t {
+  uint8_t *buf;
+  size_t pos;
+} emitter_t;
+
 // This function does the actual work of constructing the returned function. It
-// assumes the buffer is already allocated as writeable and that it's
-// sufficiently large.
-static void vcurry_write_thunk(uint8_t *buf, size_t buf_size, void *fn,
-                               size_t nargs_now, size_t nargs_later,
-                               va_list args_now);
-// Compute an upper bound on the number of bytes that `vcurry_write_thunk` will
-// write. This has to be kept in sync with that function. TODO: Improve this
-// estimate - in theory we could duplicate the code and get an exact number.
-static size_t vcurry_estimate_thunk_size(size_t nargs_now, size_t nargs_later);
-// Where we return to from `munmap`. It's actually some code.
+// writes the code for a thunk through `buf`, which is the writable alias of the
+// slot at `rx`. The slot is `slot_size` bytes, and the thunk's record goes at
+// the end of it, since the code loads the function and some arguments from the
+// record. If `classes` isn't `NULL`, it gives the class of each of the
+// `nargs_now + nargs_later` arguments, and the thunk passes them in XMM
+// registers where needed. Otherwise, they're all integers. If `persistent` is
+// set, the thunk just returns after the call instead of freeing itself. If
+// `args_now` is `NULL`, every now-arg is loaded from the record, so it can be
+// changed later. Unless `profile` is off, the thunk also updates `counters`.
+// The size of the code is returned.
+static size_t vcurry_write_thunk(uint8_t *buf, const uint8_t *rx,
+                                 size_t slot_size, size_t nargs_now,
+                                 size_t nargs_later,
+                                 const curry_arg_class_t *classes,
+                                 const uint64_t *args_now, bool persistent,
+                                 curry_profile_mode_t profile,
+                                 curry_profile_counters_t *counters);
+// Compute the exact size of the code `vcurry_write_thunk` would write
+static size_t vcurry_thunk_size(size_t nargs_now, size_t nargs_later,
+                                const curry_arg_class_t *classes,
+                                const uint64_t *args_now, bool persistent,
+                                curry_profile_mode_t profile);
+// Where we return to from `vcurry_release`. It's actually some code. The second
+// one also restores %xmm0, for thunks with floating-point arguments.
 extern uint8_t vcurry_return_trampoline;
+extern uint8_t vcurry_return_trampoline_sse;
+
+// Every thunk ends with a record describing it. The record sits at the very end
+// of the thunk's slot, and the now-args are stored just before it. That way, we
+// can find the record given just the thunk, and we can recognize our own thunks
+// when they're passed back to us.
+typedef struct thunk_record_t {
+  // A one-shot thunk that this thunk was fused with. It has to be freed when
+  // this thunk frees itself.
+  void *inner;
+  // The shared code this thunk jumps to, or `NULL` if it has its own code
+  const uint8_t *shape;
+  // The function this thunk eventually calls
+  void *fn;
+  uint16_t nargs_now;
+  uint16_t nargs_later;
+  uint16_t flags;
+  uint16_t magic;
+} thunk_record_t;
+#define THUNK_RECORD_MAGIC (0xc0de)
+#define THUNK_FLAG_PERSISTENT (1 << 0)
+// The thunk is in the intern table, and might have been handed out many times
+#define THUNK_FLAG_INTERNED (1 << 1)
+// The thunk loads all its now-args from the record, so they can be rebound
+#define THUNK_FLAG_REBINDABLE (1 << 2)
+// Some of the thunk's arguments are passed in XMM registers
+#define THUNK_FLAG_TYPED (1 << 3)
+// The thunk runs a pipeline. Its now-args are the now-args of every stage,
+// followed by the stages' functions.
+#define THUNK_FLAG_COMPOSED (1 << 4)
+// The number of bytes at the end of a slot taken up by the record and now-args
+static size_t thunk_record_size(size_t nargs_now);
+// Find the record of a thunk, or return `NULL` if `thunk` isn't one of ours
+static const thunk_record_t *vcurry_record_of(const void *thunk);
+// Write the record of a thunk into the end of its slot
+static void vcurry_write_record(uint8_t *buf, size_t buf_size, void *fn,
+                                const uint8_t *shape, size_t nargs_now,
+                                size_t nargs_later, const uint64_t *args_now,
+                                uint16_t flags, void *inner);
+// The key an interned thunk is filed under
+static curry_intern_key_t vcurry_key_of(const thunk_record_t *record);
+// Free a thunk that has been called, along with any thunks it was fused with.
+// One-shot thunks jump here once they're done.
+static void vcurry_release(void *thunk);
+
+// One-shot thunks free themselves by jumping to `vcurry_release`, with the
+// trampoline as the return address. They're far away, so the addresses are kept
+// at the start of each chunk, where thunks can reach them.
+enum {
+  CONSTANT_TRAMPOLINE,
+  CONSTANT_TRAMPOLINE_SSE,
+  CONSTANT_RELEASE,
+};
+void *const curry_slab_constants[CURRY_SLAB_NCONSTANTS] = {
+    [CONSTANT_TRAMPOLINE] = &vcurry_return_trampoline,
+    [CONSTANT_TRAMPOLINE_SSE] = &vcurry_return_trampoline_sse,
+    [CONSTANT_RELEASE] = (void *)vcurry_release,
+};
+
+// With `CURRY_OPTION_SHARED_CODE`, a thunk is just a stub followed by its
+// record. The stub loads the thunk's address into %r11 and jumps to code shared
+// by every thunk with the same shape. That code finds everything else it needs
+// in the record. Every thunk with the same shape has the same slot size, so
+// the record is always at the same offset from %r11.
+#define SHAPE_STUB_SIZE (18)
+// Write the code shared by every thunk of a shape. Like `vcurry_write_thunk`,
+// this writes through `buf` for the slot at `rx`, and it only computes the size
+// if `buf` is `NULL`. The thunks that use this code occupy slots of
+// `thunk_size` bytes.
+static size_t vcurry_write_shape(uint8_t *buf, const uint8_t *rx,
+                                 size_t thunk_size, size_t nargs_now,
+                                 size_t nargs_later, bool persistent);
+// Write the stub for a thunk that uses shared code
+static void vcurry_write_stub(uint8_t *buf, size_t buf_size);
+// Get the shared code for a shape, creating it if it doesn't exist yet
+static const uint8_t *vcurry_get_shape(size_t nargs_now, size_t nargs_later,
+                                       bool persistent);
+
+// One stage of a pipeline, after skipping any thunk of ours. It calls `fn` with
+// the `nargs_now` arguments in `args_now`, followed by what's passed to it.
+typedef struct pipeline_stage_t {
+  void *fn;
+  const uint64_t *args_now;
+  size_t nargs_now;
+} pipeline_stage_t;
+// Write the code for a pipeline thunk. Like `vcurry_write_shape`, this writes
+// through `buf`, and it only computes the size if `buf` is `NULL`. The thunk's
+// slot is `slot_size` bytes, and its record is laid out as for
+// `THUNK_FLAG_COMPOSED`.
+static size_t vcurry_write_pipeline(uint8_t *buf, size_t slot_size,
+                                    const pipeline_stage_t *stages,
+                                    size_t nstages, size_t nargs_later);
+
+// Write the code for `curry_apply_many`. It's a function taking no arguments,
+// which runs the whole batch. Everything it needs is in `pool`, which goes at
+// the end of its slot of `slot_size` bytes. That has the `nargs_now` now-args,
+// then the function, the rows, the results, and the number of rows. If
+// `store` isn't set, the results are thrown away. Like `vcurry_write_shape`,
+// this only computes the size if `buf` is `NULL`.
+#define APPLY_POOL_EXTRA (4)
+static size_t vcurry_write_apply(uint8_t *buf, size_t slot_size,
+                                 size_t nargs_now, size_t nargs_later,
+                                 const uint64_t *pool, bool store);
+
+// The current value of every option. These are read without taking any locks.
+static uint64_t curry_options[CURRY_OPTION_COUNT] = {
+    [CURRY_OPTION_THREAD_CACHE] = 64 * 1024,
+};
+
+// How code is generated on this machine. It's worked out before anything is
+// sized, and it never changes after that, so every thunk and every piece of
+// shared code agrees on how big it is.
+static curry_codegen_info_t codegen;
+static pthread_once_t codegen_once = PTHREAD_ONCE_INIT;
+static void codegen_init(void) { curry_cpu_probe(&codegen); }
+
+// Common implementation of `vcurry`, `vcurry_typed`, and their persistent
+// versions. This just collects the arguments into an array. Without `classes`,
+// every argument is an integer.
+static void *vcurry_common(void *fn, size_t nargs_now, size_t nargs_later,
+                           const curry_arg_class_t *classes, va_list args_now,
+                           bool persistent);
+// Common implementation of all the batch functions. Every other way to create a
+// thunk eventually calls this. The `classes` are as for `vcurry_write_thunk`.
+// If `region` isn't `NULL`, the thunk is created in it. There can only be one,
+// and it has to be persistent.
+static bool curry_batch_common(void *fn, size_t nargs_now, size_t nargs_later,
+                               const curry_arg_class_t *classes,
+                               const uint64_t *args, size_t count, void **out,
+                               bool persistent, curry_region_t *region);
 
 void *vcurry(void *fn, size_t nargs_now, size_t nargs_later, va_list args_now) {
+  return vcurry_common(fn, nargs_now, nargs_later, NULL, args_now, false);
+}
+
+void *vcurry_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                        va_list args_now) {
+  return vcurry_common(fn, nargs_now, nargs_later, NULL, args_now, true);
+}
+
+void *vcurry_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                   const curry_arg_class_t *classes, va_list args_now) {
+  return vcurry_common(fn, nargs_now, nargs_later, classes, args_now, false);
+}
+
+void *vcurry_typed_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                              const curry_arg_class_t *classes,
+                              va_list args_now) {
+  return vcurry_common(fn, nargs_now, nargs_later, classes, args_now, true);
+}
+
+void *vcurry_in_region(curry_region_t *region, void *fn, size_t nargs_now,
+                       size_t nargs_later, va_list args_now) {
+  // Check the number of arguments before we copy them, like `vcurry_common`
+  if (nargs_now + nargs_later > CURRY_MAX_ARGS) {
+    curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+    return NULL;
+  }
+  uint64_t args[CURRY_MAX_ARGS];
+  for (size_t i = 0; i < nargs_now; i++)
+    args[i] = va_arg(args_now, uint64_t);
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, NULL, args, 1, &ret,
+                          true, region))
+    return NULL;
+  return ret;
+}
+
+void *curry_array(void *fn, size_t nargs_now, size_t nargs_later,
+                  const uint64_t *args_now) {
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, NULL, args_now, 1, &ret,
+                          false, NULL))
+    return NULL;
+  return ret;
+}
+
+void *curry_array_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                             const uint64_t *args_now) {
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, NULL, args_now, 1, &ret,
+                          true, NULL))
+    return NULL;
+  return ret;
+}
+
+void *curry_array_typed(void *fn, size_t nargs_now, size_t nargs_later,
+                        const curry_arg_class_t *classes,
+                        const uint64_t *args_now) {
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, classes, args_now, 1,
+                          &ret, false, NULL))
+    return NULL;
+  return ret;
+}
+
+void *curry_array_typed_persistent(void *fn, size_t nargs_now,
+                                   size_t nargs_later,
+                                   const curry_arg_class_t *classes,
+                                   const uint64_t *args_now) {
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, classes, args_now, 1,
+                          &ret, true, NULL))
+    return NULL;
+  return ret;
+}
+
+bool curry_batch(void *fn, size_t nargs_now, size_t nargs_later,
+                 const uint64_t *args, size_t count, void **out) {
+  return curry_batch_common(fn, nargs_now, nargs_later, NULL, args, count, out,
+                            false, NULL);
+}
+
+bool curry_batch_persistent(void *fn, size_t nargs_now, size_t nargs_later,
+                            const uint64_t *args, size_t count, void **out) {
+  return curry_batch_common(fn, nargs_now, nargs_later, NULL, args, count, out,
+                            true, NULL);
+}
+
+bool curry_set_option(curry_option_t option, uint64_t value) {
+  if (option >= CURRY_OPTION_COUNT)
+    return false;
+  switch (option) {
+  case CURRY_OPTION_SHARED_CODE:
+  case CURRY_OPTION_INTERN:
+  case CURRY_OPTION_REBINDABLE:
+  case CURRY_OPTION_PERF_MAP:
+    if (value > 1)
+      return false;
+    break;
+  case CURRY_OPTION_HUGE_PAGES:
+    if (value > CURRY_PAGES_HUGETLB)
+      return false;
+    break;
+  case CURRY_OPTION_PROFILE:
+    if (value > CURRY_PROFILE_CYCLES)
+      return false;
+    break;
+  default:
+    break;
+  }
+  __atomic_store_n(&curry_options[option], value, __ATOMIC_RELAXED);
+  return true;
+}
+
+uint64_t curry_get_option(curry_option_t option) {
+  if (option >= CURRY_OPTION_COUNT)
+    return 0;
+  return __atomic_load_n(&curry_options[option], __ATOMIC_RELAXED);
+}
+
+void curry_free(void *thunk) {
+  // We might be given a function that we returned because there were no
+  // now-args. That wasn't allocated by us, so there's nothing to do.
+  const thunk_record_t *const record = vcurry_record_of(thunk);
+  if (record == NULL)
+    return;
+  // Interned thunks might have been handed out more than once. Only the last
+  // reference actually frees it.
+  if ((record->flags & THUNK_FLAG_INTERNED) != 0) {
+    const curry_intern_key_t key = vcurry_key_of(record);
+    if (!curry_intern_release(&key, thunk))
+      return;
+  }
+  // Don't free any fused thunks. If this thunk were never called, neither would
+  // they have been, so the caller is still responsible for them.
+  const size_t slot_size = curry_slab_slot_size(thunk);
+  uint8_t *const rw = curry_slab_writable(thunk);
+  ((thunk_record_t *)(rw + slot_size - sizeof(thunk_record_t)))->magic = 0;
+  CURRY_PROBE1(free, thunk);
+  curry_stats_freed(slot_size);
+  curry_slab_free(thunk);
+}
+
+bool curry_rebind(void *thunk, size_t idx, uint64_t value) {
+  const thunk_record_t *const record = vcurry_record_of(thunk);
+  if (record == NULL || (record->flags & THUNK_FLAG_REBINDABLE) == 0 ||
+      idx >= record->nargs_now)
+    return false;
+  // The thunk reads its arguments with single loads, and they're aligned, so
+  // a call sees either the old value or the new one
+  const size_t slot_size = curry_slab_slot_size(thunk);
+  uint8_t *const rw = curry_slab_writable(thunk);
+  uint64_t *const args =
+      (uint64_t *)(rw + slot_size - thunk_record_size(record->nargs_now));
+  __atomic_store_n(&args[idx], value, __ATOMIC_RELEASE);
+  return true;
+}
+
+void *curry_compose(void *g, void *f, size_t nargs_later) {
+  void *const stages[2] = {f, g};
+  return curry_pipeline(stages, 2, nargs_later);
+}
+
+void *curry_pipeline(void *const *stages, size_t nstages, size_t nargs_later) {
+  // A pipeline with one stage is just that stage
+  if (nstages == 0)
+    return NULL;
+  if (nstages == 1)
+    return stages[0];
+  if (nstages > CURRY_MAX_ARGS || nargs_later > CURRY_MAX_ARGS) {
+    curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+    return NULL;
+  }
+  pthread_once(&codegen_once, codegen_init);
+
+  // Skip any stages that are our own thunks, the same way `curry_batch_common`
+  // fuses with them, and collect their now-args. Those are copied, so the
+  // pipeline doesn't depend on the thunks. The functions go after all of the
+  // now-args, and everything has to fit in the record.
+  pipeline_stage_t resolved[CURRY_MAX_ARGS];
+  uint64_t pool[CURRY_MAX_ARGS];
+  size_t npool = 0;
+  for (size_t i = 0; i < nstages; i++) {
+    const size_t nargs_stage = i == 0 ? nargs_later : 1;
+    const thunk_record_t *const record = vcurry_record_of(stages[i]);
+    const bool skip =
+        record != NULL && record->nargs_later == nargs_stage &&
+        (record->flags & THUNK_FLAG_PERSISTENT) != 0 &&
+        (record->flags & (THUNK_FLAG_REBINDABLE | THUNK_FLAG_TYPED |
+                          THUNK_FLAG_COMPOSED)) == 0;
+    const size_t nargs_now = skip ? record->nargs_now : 0;
+    if (npool + nargs_now + nstages > CURRY_MAX_ARGS ||
+        nargs_now + nargs_stage > CURRY_MAX_ARGS) {
+      curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+      return NULL;
+    }
+    resolved[i] = (pipeline_stage_t){
+        .fn = skip ? record->fn : stages[i],
+        .args_now = &pool[npool],
+        .nargs_now = nargs_now,
+    };
+    for (size_t j = 0; j < nargs_now; j++)
+      pool[npool++] = ((const uint64_t *)record - nargs_now)[j];
+  }
+  for (size_t i = 0; i < nstages; i++)
+    pool[npool++] = (uintptr_t)resolved[i].fn;
+
+  // Size the code, then write it along with the record
+  const size_t code_size =
+      vcurry_write_pipeline(NULL, 0, resolved, nstages, nargs_later);
+  const size_t thunk_size =
+      curry_slab_size_for(code_size + thunk_record_size(npool));
+  void *const ret = thunk_size != 0 ? curry_slab_alloc(thunk_size) : NULL;
+  if (ret == NULL) {
+    curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+    return NULL;
+  }
+  uint8_t *const rw = curry_slab_writable(ret);
+  const size_t size =
+      vcurry_write_pipeline(rw, thunk_size, resolved, nstages, nargs_later);
+  assert(size == code_size);
+  void *const fn_last = resolved[nstages - 1].fn;
+  vcurry_write_record(rw, thunk_size, fn_last, NULL, npool, nargs_later, pool,
+                      THUNK_FLAG_PERSISTENT | THUNK_FLAG_COMPOSED, NULL);
+  CURRY_PROBE2(create, ret, thunk_size);
+  if (curry_get_option(CURRY_OPTION_PERF_MAP))
+    curry_perf_thunk(ret, size, fn_last, npool - nstages, nargs_later);
+  curry_stats_created(thunk_size, 1);
+  return ret;
+}
+
+bool curry_apply_many(void *fn, size_t nargs_now, size_t nargs_later,
+                      const uint64_t *args_now, const uint64_t *rows,
+                      size_t nrows, uint64_t *results) {
+  if (nargs_now + nargs_later > CURRY_MAX_ARGS) {
+    curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+    return false;
+  }
+  if (nrows == 0)
+    return true;
+  pthread_once(&codegen_once, codegen_init);
+
+  // Skip the function if it's one of our thunks, the same way
+  // `curry_batch_common` fuses with it. It can't be one-shot anyway, since
+  // it's called for every row.
+  const thunk_record_t *const inner = vcurry_record_of(fn);
+  const bool fuse =
+      inner != NULL && inner->nargs_later == nargs_now + nargs_later &&
+      (inner->flags & THUNK_FLAG_PERSISTENT) != 0 &&
+      (inner->flags & (THUNK_FLAG_REBINDABLE | THUNK_FLAG_TYPED |
+                       THUNK_FLAG_COMPOSED)) == 0;
+  const size_t nargs_inner = fuse ? inner->nargs_now : 0;
+  const size_t nargs_total_now = nargs_inner + nargs_now;
+  assert(nargs_total_now + nargs_later <= CURRY_MAX_ARGS);
+
+  // Collect everything the loop needs
+  uint64_t pool[CURRY_MAX_ARGS + APPLY_POOL_EXTRA];
+  for (size_t i = 0; i < nargs_inner; i++)
+    pool[i] = ((const uint64_t *)inner - nargs_inner)[i];
+  for (size_t i = 0; i < nargs_now; i++)
+    pool[nargs_inner + i] = args_now[i];
+  pool[nargs_total_now + 0] = (uintptr_t)(fuse ? inner->fn : fn);
+  pool[nargs_total_now + 1] = (uintptr_t)rows;
+  pool[nargs_total_now + 2] = (uintptr_t)results;
+  pool[nargs_total_now + 3] = nrows;
+  const size_t pool_size = 8 * (nargs_total_now + APPLY_POOL_EXTRA);
+
+  // The loop is generated for this batch, run once, and thrown away. It isn't
+  // a thunk, so it doesn't have a record, and it isn't counted as one.
+  const bool store = results != NULL;
+  const size_t code_size = vcurry_write_apply(NULL, 0, nargs_total_now,
+                                              nargs_later, pool, store);
+  const size_t slot_size = curry_slab_size_for(code_size + pool_size);
+  uint8_t *const code = slot_size != 0 ? curry_slab_alloc(slot_size) : NULL;
+  if (code == NULL) {
+    curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+    return false;
+  }
+  uint8_t *const rw = curry_slab_writable(code);
+  const size_t size = vcurry_write_apply(rw, slot_size, nargs_total_now,
+                                         nargs_later, pool, store);
+  assert(size == code_size);
+  (void)size;
+  memcpy(rw + slot_size - pool_size, pool, pool_size);
+  ((void (*)(void))code)();
+  curry_slab_free(code);
+  return true;
+}
+
+bool curry_reserve(size_t nthunks, size_t max_args) {
+  if (max_args > CURRY_MAX_ARGS)
+    return false;
+  pthread_once(&codegen_once, codegen_init);
+  // Find the biggest slot any thunk with this many arguments could need. It's
+  // biggest when none of the now-args fit in an immediate. The code doesn't
+  // always grow with the number of arguments, so try every split.
+  uint64_t args[CURRY_MAX_ARGS];
+  for (size_t i = 0; i < max_args; i++)
+    args[i] = UINT64_C(0x0123456789abcdef);
+  const curry_profile_mode_t profile = curry_get_option(CURRY_OPTION_PROFILE);
+  const bool shared = curry_get_option(CURRY_OPTION_SHARED_CODE) != 0 &&
+                      profile == CURRY_PROFILE_OFF;
+  size_t max_size = 0;
+  for (size_t nargs_now = 1; nargs_now <= max_args; nargs_now++) {
+    for (size_t nargs_later = 0; nargs_now + nargs_later <= max_args;
+         nargs_later++) {
+      for (int persistent = 0; persistent <= 1; persistent++) {
+        const size_t code_size =
+            shared ? SHAPE_STUB_SIZE
+                   : vcurry_thunk_size(nargs_now, nargs_later, NULL, args,
+                                       persistent, profile);
+        const size_t size = code_size + thunk_record_size(nargs_now);
+        if (size > max_size)
+          max_size = size;
+      }
+    }
+  }
+  if (max_size == 0)
+    return true;
+  return curry_slab_reserve(max_size, nthunks);
+}
+
+void curry_trim(void) {
+  curry_region_trim();
+  curry_slab_trim();
+}
+
+void curry_codegen_info(curry_codegen_info_t *info) {
+  pthread_once(&codegen_once, codegen_init);
+  *info = codegen;
+}
+
+static void *vcurry_common(void *fn, size_t nargs_now, size_t nargs_later,
+                           const curry_arg_class_t *classes, va_list args_now,
+                           bool persistent) {
+  // Check the number of arguments before we copy them, so we don't overflow
+  // our buffer. This check is repeated later, but that's cheap. We also have to
+  // know the classes are valid to read the arguments.
+  if (nargs_now + nargs_later > CURRY_MAX_ARGS) {
+    curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+    return NULL;
+  }
+  for (size_t i = 0; classes != NULL && i < nargs_now + nargs_later; i++) {
+    if (classes[i] > CURRY_ARG_FLOAT)
+      return NULL;
+  }
+
+  // Floating-point arguments come to us as `double`, and they're kept as their
+  // bits. A `float` only uses the low half of its register.
+  uint64_t args[CURRY_MAX_ARGS];
+  for (size_t i = 0; i < nargs_now; i++) {
+    const curry_arg_class_t class =
+        classes != NULL ? classes[i] : CURRY_ARG_INTEGER;
+    if (class == CURRY_ARG_INTEGER) {
+      args[i] = va_arg(args_now, uint64_t);
+    } else if (class == CURRY_ARG_DOUBLE) {
+      const double value = va_arg(args_now, double);
+      memcpy(&args[i], &value, sizeof(value));
+    } else {
+      const float value = va_arg(args_now, double);
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(value));
+      args[i] = bits;
+    }
+  }
+
+  void *ret;
+  if (!curry_batch_common(fn, nargs_now, nargs_later, classes, args, 1, &ret,
+                          persistent, NULL))
+    return NULL;
+  return ret;
+}
+
+static bool curry_batch_common(void *fn, size_t nargs_now, size_t nargs_later,
+                               const curry_arg_class_t *classes,
+                               const uint64_t *args, size_t count, void **out,
+                               bool persistent, curry_region_t *region) {
+  assert((region == NULL || (persistent && count == 1)) &&
+         "Region thunks are persistent, and made one at a time");
 
   // We can have zero now-args and zero later-args. If we have no now-args, we
   // can just return the supplied function since it already does what we want.
   // If we have no later-args is zero, we will return a thunk that will call
   // `fn` with the arguments we've already received.
-  if (nargs_now == 0)
-    return fn;
+  if (nargs_now == 0) {
+    for (size_t i = 0; i < count; i++)
+      out[i] = fn;
+    return true;
+  }
   // If we have too many arguments, just fail
-  if (nargs_now + nargs_later > CURRY_MAX_ARGS)
-    return NULL;
+  if (nargs_now + nargs_later > CURRY_MAX_ARGS) {
+    curry_stats_failed(CURRY_FAILURE_TOO_MANY_ARGS);
+    return false;
+  }
+  pthread_once(&codegen_once, codegen_init);
 
-  // Allocate a buffer to store the generated code. This has to be done with
-  // `mmap` since we will be changing its permissions later.
-  const size_t ret_size = vcurry_estimate_thunk_size(nargs_now, nargs_later);
-  uint8_t *const ret = mmap(NULL, ret_size, PROT_READ | PROT_WRITE,
-                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  if (ret == MAP_FAILED)
-    return NULL;
+  // Rebindable thunks load their now-args from the record, so they can be
+  // changed after the thunk is made. Thunks in a region can't be found by
+  // `curry_rebind`, so there's no point.
+  const bool rebindable = persistent && region == NULL &&
+                          curry_get_option(CURRY_OPTION_REBINDABLE);
+
+  // Thunks that pass some arguments in XMM registers are generated differently.
+  // If every argument is an integer, the classes don't change anything.
+  bool typed = false;
+  for (size_t i = 0; classes != NULL && i < nargs_now + nargs_later; i++) {
+    if (classes[i] > CURRY_ARG_FLOAT)
+      return false;
+    if (classes[i] != CURRY_ARG_INTEGER)
+      typed = true;
+  }
+  if (!typed)
+    classes = NULL;
 
-  // Actually construct the thunk
-  vcurry_write_thunk(ret, ret_size, fn, nargs_now, nargs_later, args_now);
+  // If we're currying one of our own thunks, we can skip it entirely. Instead,
+  // we call its function directly, with its now-args followed by ours. This
+  // only works if the caller agrees with the thunk on how many arguments it
+  // takes. Also, if the thunk is one-shot, it would have been called exactly
+  // once. So, we can only do this for one one-shot thunk at a time, and we have
+  // to free it whenever the new thunk frees itself. Persistent thunks never
+  // free what they were fused with, so they can't take over a one-shot thunk
+  // either, and neither can thunks in a region, which are never freed on their
+  // own. Rebindable thunks are never fused, so their arguments stay where they
+  // were bound, and changes to them are seen by everything that calls them.
+  // Neither are thunks with floating-point arguments, since the record doesn't
+  // say which arguments those are, or pipelines, since they call more than one
+  // function.
+  const thunk_record_t *const inner = vcurry_record_of(fn);
+  const bool fuse =
+      inner != NULL && inner->nargs_later == nargs_now + nargs_later &&
+      ((inner->flags & THUNK_FLAG_PERSISTENT) != 0 ||
+       (!persistent && count == 1 && region == NULL)) &&
+      (inner->flags & (THUNK_FLAG_REBINDABLE | THUNK_FLAG_TYPED |
+                       THUNK_FLAG_COMPOSED)) == 0 &&
+      !rebindable && !typed;
+  const size_t nargs_inner = fuse ? inner->nargs_now : 0;
+  const uint64_t *const args_inner =
+      fuse ? (const uint64_t *)inner - nargs_inner : NULL;
+  void *const fn_target = fuse ? inner->fn : fn;
+  void *const fn_inner =
+      fuse && (inner->flags & THUNK_FLAG_PERSISTENT) == 0 ? fn : NULL;
+  const size_t nargs_total_now = nargs_inner + nargs_now;
+  assert(nargs_total_now + nargs_later <= CURRY_MAX_ARGS);
 
-  // Make the buffer executable, and return it. On failure, remember to free the
-  // buffer.
-  if (mprotect(ret, ret_size, PROT_READ | PROT_EXEC) == -1) {
-    munmap(ret, ret_size);
+  // Interned thunks are looked up one at a time. Thunks that free a one-shot
+  // thunk they were fused with can only be used once, so they aren't shared.
+  // Neither are rebindable thunks, since rebinding one would change it for
+  // everyone it was handed out to. Thunks with floating-point arguments aren't
+  // either, since the key doesn't have their classes. Neither are thunks in a
+  // region, since they're freed with it.
+  const bool intern = persistent && fn_inner == NULL && !rebindable &&
+                      !typed && region == NULL &&
+                      curry_get_option(CURRY_OPTION_INTERN);
+  if (intern && count > 1) {
+    for (size_t i = 0; i < count; i++) {
+      if (!curry_batch_common(fn, nargs_now, nargs_later, classes,
+                              args + i * nargs_now, 1, &out[i], persistent,
+                              NULL)) {
+        for (size_t j = 0; j < i; j++)
+          curry_free(out[j]);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Collect the now-args for each thunk, after the ones we're fusing with. If
+  // there's only one thunk, we can do that once up front.
+  uint64_t args_merged[CURRY_MAX_ARGS];
+  for (size_t i = 0; i < nargs_inner; i++)
+    args_merged[i] = args_inner[i];
+  if (count == 1) {
+    for (size_t j = 0; j < nargs_now; j++)
+      args_merged[nargs_inner + j] = args[j];
+  }
+
+  // The thunk's behavior only depends on what's in its record, so that's what
+  // it's interned by. If it already exists, we're done.
+  const curry_intern_key_t key = {
+      .fn = fn_target,
+      .args = args_merged,
+      .nargs_now = nargs_total_now,
+      .nargs_later = nargs_later,
+  };
+  if (intern) {
+    void *const existing = curry_intern_acquire(&key);
+    if (existing != NULL) {
+      out[0] = existing;
+      return true;
+    }
+  }
+
+  // Profiled thunks update counters shared by every thunk with the same
+  // function and shape
+  const curry_profile_mode_t profile = curry_get_option(CURRY_OPTION_PROFILE);
+  curry_profile_counters_t *counters = NULL;
+  if (profile != CURRY_PROFILE_OFF) {
+    counters = curry_profile_counters(fn_target, nargs_total_now, nargs_later);
+    if (counters == NULL) {
+      curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+      return false;
+    }
+  }
+
+  // If we're sharing code between thunks, we need the code for this shape, and
+  // the thunk itself is just a stub. Otherwise, we have to generate the code.
+  // How big it is depends on the arguments, and all the thunks have to fit in
+  // the same size of slot. Profiled thunks always get their own code, since
+  // that's what updates their counters. So do thunks with floating-point
+  // arguments, since the shared code only handles integers, and thunks in a
+  // region, since the shared code expects the record at the end of a slot.
+  const uint8_t *shape = NULL;
+  size_t code_size = 0;
+  if (curry_get_option(CURRY_OPTION_SHARED_CODE) &&
+      profile == CURRY_PROFILE_OFF && !typed && region == NULL) {
+    shape = vcurry_get_shape(nargs_total_now, nargs_later, persistent);
+    if (shape == NULL) {
+      curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+      return false;
+    }
+    code_size = SHAPE_STUB_SIZE;
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      if (count != 1) {
+        for (size_t j = 0; j < nargs_now; j++)
+          args_merged[nargs_inner + j] = args[i * nargs_now + j];
+      }
+      const size_t size =
+          vcurry_thunk_size(nargs_total_now, nargs_later, classes,
+                            rebindable ? NULL : args_merged, persistent,
+                            profile);
+      if (size > code_size)
+        code_size = size;
+    }
+  }
+
+  // Allocate slots to store the thunks. All of them have the same size, so we
+  // can get all of them at once. A thunk in a region is packed in right after
+  // the last one, and its writable view comes from the region too.
+  const size_t record_size = thunk_record_size(nargs_total_now);
+  const size_t thunk_size = region != NULL
+                                ? curry_region_size_for(code_size + record_size)
+                                : curry_slab_size_for(code_size + record_size);
+  uint8_t *rw_region = NULL;
+  bool allocated = thunk_size != 0;
+  if (allocated && region != NULL) {
+    out[0] = curry_region_alloc(region, thunk_size, &rw_region);
+    allocated = out[0] != NULL;
+  } else if (allocated) {
+    allocated = curry_slab_alloc_many(thunk_size, count, out);
+  }
+  if (!allocated) {
+    curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+    return false;
+  }
+
+  // The slots themselves are never writable, so we write the thunks through
+  // their aliases. The code only uses relative addressing within its own chunk,
+  // so it doesn't matter which view it's written through.
+  const bool perf_map = curry_get_option(CURRY_OPTION_PERF_MAP);
+  const uint16_t flags = (persistent ? THUNK_FLAG_PERSISTENT : 0) |
+                         (intern ? THUNK_FLAG_INTERNED : 0) |
+                         (rebindable ? THUNK_FLAG_REBINDABLE : 0) |
+                         (typed ? THUNK_FLAG_TYPED : 0);
+  for (size_t i = 0; i < count; i++) {
+    if (count != 1) {
+      for (size_t j = 0; j < nargs_now; j++)
+        args_merged[nargs_inner + j] = args[i * nargs_now + j];
+    }
+    uint8_t *const rw =
+        region != NULL ? rw_region : curry_slab_writable(out[i]);
+    size_t size = SHAPE_STUB_SIZE;
+    if (shape != NULL) {
+      vcurry_write_stub(rw, thunk_size);
+    } else {
+      size = vcurry_write_thunk(rw, out[i], thunk_size, nargs_total_now,
+                                nargs_later, classes,
+                                rebindable ? NULL : args_merged, persistent,
+                                profile, counters);
+      assert(size <= code_size);
+    }
+    vcurry_write_record(rw, thunk_size, fn_target, shape, nargs_total_now,
+                        nargs_later, args_merged, flags, fn_inner);
+    CURRY_PROBE2(create, out[i], thunk_size);
+    if (perf_map)
+      curry_perf_thunk(out[i], size, fn_target, nargs_total_now, nargs_later);
+  }
+  curry_stats_created(thunk_size, count);
+
+  // Another thread might have interned the same thunk while we were making
+  // ours. If so, use theirs instead.
+  if (intern) {
+    void *const interned = curry_intern_insert(&key, out[0]);
+    if (interned != out[0]) {
+      vcurry_release(out[0]);
+      if (interned == NULL) {
+        curry_stats_failed(CURRY_FAILURE_NO_MEMORY);
+        return false;
+      }
+      out[0] = interned;
+    }
+  }
+  return true;
+}
+
+static size_t thunk_record_size(size_t nargs_now) {
+  return sizeof(thunk_record_t) + 8 * nargs_now;
+}
+
+static const thunk_record_t *vcurry_record_of(const void *thunk) {
+  // Thunks always start at the start of a slot
+  const size_t slot_size = curry_slab_slot_size(thunk);
+  if (slot_size == 0)
+    return NULL;
+  const thunk_record_t *const ret =
+      (const thunk_record_t *)((const uint8_t *)thunk + slot_size -
+                               sizeof(thunk_record_t));
+  if (ret->magic != THUNK_RECORD_MAGIC)
     return NULL;
+  return ret;
+}
+
+static void vcurry_write_record(uint8_t *buf, size_t buf_size, void *fn,
+                                const uint8_t *shape, size_t nargs_now,
+                                size_t nargs_later, const uint64_t *args_now,
+                                uint16_t flags, void *inner) {
+  thunk_record_t *const record =
+      (thunk_record_t *)(buf + buf_size - sizeof(thunk_record_t));
+  uint64_t *const record_args = (uint64_t *)record - nargs_now;
+  for (size_t i = 0; i < nargs_now; i++)
+    record_args[i] = args_now[i];
+  record->inner = inner;
+  record->shape = shape;
+  record->fn = fn;
+  record->nargs_now = nargs_now;
+  record->nargs_later = nargs_later;
+  record->flags = flags;
+  record->magic = THUNK_RECORD_MAGIC;
+}
+
+static curry_intern_key_t vcurry_key_of(const thunk_record_t *record) {
+  return (curry_intern_key_t){
+      .fn = record->fn,
+      .args = (const uint64_t *)record - record->nargs_now,
+      .nargs_now = record->nargs_now,
+      .nargs_later = record->nargs_later,
+  };
+}
+
+static void vcurry_release(void *thunk) {
+  // Walk down the chain of fused thunks, freeing each one. Make sure to clear
+  // the magic number so the slot isn't mistaken for a thunk after it's freed.
+  while (thunk != NULL) {
+    const size_t slot_size = curry_slab_slot_size(thunk);
+    uint8_t *const rw = curry_slab_writable(thunk);
+    thunk_record_t *const record =
+        (thunk_record_t *)(rw + slot_size - sizeof(thunk_record_t));
+    void *const next = record->inner;
+    record->magic = 0;
+    CURRY_PROBE1(free, thunk);
+    curry_stats_freed(slot_size);
+    curry_slab_free(thunk);
+    thunk = next;
   }
+}
+
+// Shared code for each shape, indexed by whether the thunks are persistent,
+// then by the number of now-args, then by the number of later-args. The rows
+// are allocated lazily, since most programs only use a few shapes. Entries are
+// only ever written once, under the lock, so they can be read without it.
+static const uint8_t **shape_cache[2][CURRY_MAX_ARGS + 1];
+static pthread_mutex_t shape_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const uint8_t *vcurry_get_shape(size_t nargs_now, size_t nargs_later,
+                                       bool persistent) {
+  assert(nargs_now + nargs_later <= CURRY_MAX_ARGS);
+
+  // Fast path: the code already exists
+  const uint8_t **row =
+      __atomic_load_n(&shape_cache[persistent][nargs_now], __ATOMIC_ACQUIRE);
+  if (row != NULL) {
+    const uint8_t *const ret =
+        __atomic_load_n(&row[nargs_later], __ATOMIC_ACQUIRE);
+    if (ret != NULL)
+      return ret;
+  }
+
+  // Slow path: create it. Check again once we have the lock, since someone
+  // else might have beaten us to it.
+  pthread_mutex_lock(&shape_lock);
+  row = shape_cache[persistent][nargs_now];
+  if (row == NULL) {
+    row = calloc(CURRY_MAX_ARGS + 1, sizeof(const uint8_t *));
+    if (row == NULL) {
+      pthread_mutex_unlock(&shape_lock);
+      return NULL;
+    }
+    __atomic_store_n(&shape_cache[persistent][nargs_now], row,
+                     __ATOMIC_RELEASE);
+  }
+  uint8_t *ret = (uint8_t *)row[nargs_later];
+  if (ret == NULL) {
+    // The code lives in the same place as all the other thunks. It's never
+    // freed.
+    const size_t thunk_size =
+        curry_slab_size_for(SHAPE_STUB_SIZE + thunk_record_size(nargs_now));
+    assert(thunk_size != 0 && "Too many now-args for a stub");
+    const size_t size = vcurry_write_shape(NULL, NULL, thunk_size, nargs_now,
+                                           nargs_later, persistent);
+    ret = curry_slab_alloc(size);
+    if (ret != NULL) {
+      vcurry_write_shape(curry_slab_writable(ret), ret, thunk_size, nargs_now,
+                         nargs_later, persistent);
+      __atomic_store_n(&row[nargs_later], ret, __ATOMIC_RELEASE);
+      if (curry_get_option(CURRY_OPTION_PERF_MAP))
+        curry_perf_shape(ret, size, nargs_now, nargs_later, persistent);
+    }
+  }
+  pthread_mutex_unlock(&shape_lock);
   return ret;
 }
 
@@ -79,6 +973,7 @@ typedef enum reg_id_t {
   REG_ID_RAX = 0,
   REG_ID_RCX = 1,
   REG_ID_RDX = 2,
+  REG_ID_RBX = 3,
   REG_ID_RSP = 4,
   REG_ID_RBP = 5,
   REG_ID_RSI = 6,
@@ -87,57 +982,685 @@ typedef enum reg_id_t {
   REG_ID_R9 = 9,
   REG_ID_R10 = 10,
   REG_ID_R11 = 11,
+  REG_ID_R12 = 12,
+  REG_ID_R13 = 13,
 } reg_id_t;
 
 // Convert an argument index to a register identifier
 static reg_id_t argidx_to_regid(size_t argidx);
 
+// Opcode extensions for the instructions with opcode 0xff that we use. These
+// all take a memory operand holding an address.
+typedef enum ff_op_t {
+  FF_OP_CALL = 2,
+  FF_OP_JMP = 4,
+  FF_OP_PUSH = 6,
+} ff_op_t;
+
+// Emit raw bytes
+static void emit_u8(emitter_t *e, uint8_t x);
+static void emit_u32(emitter_t *e, uint32_t x);
+// Emit: endbr64
+// This is left out if indirect branch tracking can't be on.
+static void emit_endbr64(emitter_t *e);
 // Emit: mov $(dst), $(src)
-static uint8_t *emit_mov_reg_reg(uint8_t *cur, reg_id_t dst, reg_id_t src);
-// Emit: mov [%rsp + $(8 * off)], $(src)
-static uint8_t *emit_mov_rsp_reg(uint8_t *cur, size_t slot, reg_id_t src);
-// Emit: mov $(dst), [%rbp + $(8 * off + 16)]
-static uint8_t *emit_mov_reg_rbp(uint8_t *cur, reg_id_t dst, size_t slot);
-// Emit: mov $(dst), $(imm)
-static uint8_t *emit_mov_reg_imm(uint8_t *cur, reg_id_t dst, uint64_t imm);
+static void emit_mov_reg_reg(emitter_t *e, reg_id_t dst, reg_id_t src);
+// Emit the shortest code to set $(dst) to $(imm). If no immediate form is short
+// enough, the value is loaded from `pool`, which is the offset from the start
+// of the code where a copy of it is stored.
+static void emit_mov_reg_imm(emitter_t *e, reg_id_t dst, uint64_t imm,
+                             int64_t pool);
+// Emit the shortest code to store $(imm) to [$(base) + $(disp)]. This might
+// clobber %rax, and `pool` is the same as for `emit_mov_reg_imm`.
+static void emit_mov_mem_imm(emitter_t *e, reg_id_t base, int32_t disp,
+                             uint64_t imm, int64_t pool);
+// Emit: mov $(dst), [$(base) + $(disp)]
+static void emit_mov_reg_mem(emitter_t *e, reg_id_t dst, reg_id_t base,
+                             int32_t disp);
+// Emit: mov [$(base) + $(disp)], $(src)
+static void emit_mov_mem_reg(emitter_t *e, reg_id_t base, int32_t disp,
+                             reg_id_t src);
+// Emit: mov $(dst), [%rip + $(target)]
+static void emit_mov_reg_rip(emitter_t *e, reg_id_t dst, int64_t target);
+// Emit: lea $(dst), [%rip + $(target)]
+static void emit_lea_rip(emitter_t *e, reg_id_t dst, int64_t target);
+// Emit: $(op) [$(base) + $(disp)]
+static void emit_ff_mem(emitter_t *e, ff_op_t op, reg_id_t base, int32_t disp);
+// Emit: $(op) [%rip + $(target)]
+static void emit_ff_rip(emitter_t *e, ff_op_t op, int64_t target);
+// For all the RIP-relative instructions, `target` is an offset from the start
+// of the code, not from the instruction.
+
+// Emit code to copy `count` 8-byte slots from [$(src) + $(src_disp)] to
+// [$(dst) + $(dst_disp)]. This clobbers %rax, %r10, and %ymm15, but no argument
+// registers. Short blocks are copied one slot at a time. Longer ones are copied
+// with a loop, so the code doesn't grow with the number of arguments. With AVX,
+// the loop copies four slots at a time.
+static void emit_copy_block(emitter_t *e, reg_id_t dst, int32_t dst_disp,
+                            reg_id_t src, int32_t src_disp, size_t count);
+// The shortest block that's copied with a loop. Below this, copying each slot
+// individually is about as small, and it's faster.
+#define COPY_LOOP_MIN (8)
+
+// Whether a thunk can skip setting up a frame. Persistent thunks whose
+// arguments all fit in registers don't need the stack at all, and they don't
+// have to do anything after the call. So, they just shuffle the registers and
+// jump to the function, which returns straight to the thunk's caller. Thunks
+// that time their calls have to get control back afterwards, though.
+static bool vcurry_is_frameless(size_t nargs_now, size_t nargs_later,
+                                bool persistent,
+                                curry_profile_mode_t profile) {
+  return persistent && nargs_now + nargs_later <= 6 &&
+         profile != CURRY_PROFILE_CYCLES;
+}
+
+// Emit the start of a thunk, up to and including the frame setup. The frame
+// has room for `nslots` 8-byte overflow-args at the top of the stack. If
+// `save_slot` is set, an extra 8-byte slot is reserved just below the saved
+// base pointer, at [%rbp - 8].
+static void emit_thunk_prologue(emitter_t *e, size_t nslots, bool save_slot);
+// The number of overflow-args when all the arguments are integers
+static size_t nslots_of(size_t nargs_total) {
+  return nargs_total > 6 ? nargs_total - 6 : 0;
+}
+// Emit code to move the later-args to where they need to be for the call
+static void emit_thunk_later_args(emitter_t *e, size_t nargs_now,
+                                  size_t nargs_later);
+// Emit code to count a call in `counters`. This clobbers %r11, so it has to
+// come before anything else uses it.
+static void emit_profile_count(emitter_t *e,
+                               curry_profile_counters_t *counters);
+// Emit code to read the time stamp counter, just before the call, into the
+// thunk's save slot. This clobbers %rax and %r11.
+static void emit_profile_start(emitter_t *e);
+// Emit code to add the cycles since `emit_profile_start` to `counters`, just
+// after the call. This leaves the return value in %rax and %rdx intact, but
+// clobbers %r10 and %r11.
+static void emit_profile_stop(emitter_t *e, curry_profile_counters_t *counters);
+// Emit code to free a thunk and return to its caller. This is used by one-shot
+// thunks after the call and `leave`. It expects the return value in %rax and
+// the address of the thunk to free in %rdi. If `sse` is set, the return value
+// in %xmm0 is kept too. The code is going into the slot at `rx`, so it can
+// find the constants for that slot's chunk.
+static void emit_thunk_self_free(emitter_t *e, const uint8_t *rx, bool sse);
+
+// Where an argument is passed. Integer and floating-point arguments take
+// registers of their own kind in order, and the ones that don't fit go on the
+// stack in argument order. The `index` counts within each kind.
+typedef enum arg_loc_kind_t {
+  ARG_LOC_GPR,
+  ARG_LOC_XMM,
+  ARG_LOC_STACK,
+} arg_loc_kind_t;
+typedef struct arg_loc_t {
+  uint16_t kind;
+  uint16_t index;
+} arg_loc_t;
+// Find where each of `nargs` arguments of the given classes is passed. Returns
+// the number of stack slots they take up.
+static size_t vcurry_classify(const curry_arg_class_t *classes, size_t nargs,
+                              arg_loc_t *locs);
+// Emit: movaps %xmm$(dst), %xmm$(src)
+static void emit_movaps_xmm_xmm(emitter_t *e, size_t dst, size_t src);
+// Emit: xorps %xmm$(dst), %xmm$(dst)
+static void emit_xorps_xmm(emitter_t *e, size_t dst);
+// Emit: movq %xmm$(dst), [%rip + $(target)]
+static void emit_movq_xmm_rip(emitter_t *e, size_t dst, int64_t target);
+// Emit: movq [$(base) + $(disp)], %xmm$(src)
+static void emit_movq_mem_xmm(emitter_t *e, reg_id_t base, int32_t disp,
+                              size_t src);
+
+// Emit a thunk whose arguments aren't all integers. This has the same
+// parameters as `vcurry_emit_thunk`, plus the class of every argument.
+static inline void vcurry_emit_typed_thunk(
+    emitter_t *e, const uint8_t *rx, size_t slot_size, size_t nargs_now,
+    size_t nargs_later, const curry_arg_class_t *classes,
+    const uint64_t *args_now, bool persistent, curry_profile_mode_t profile,
+    curry_profile_counters_t *counters);
+
+// Both passes over a thunk share this. It's inlined into each of them, so
+// when sizing, the compiler can see that nothing is written.
+static inline void vcurry_emit_thunk(emitter_t *e, const uint8_t *rx,
+                                     size_t slot_size, size_t nargs_now,
+                                     size_t nargs_later,
+                                     const uint64_t *args_now,
+                                     bool persistent,
+                                     curry_profile_mode_t profile,
+                                     curry_profile_counters_t *counters) {
+  // Figure out where the record is relative to the thunk. The now-args and the
+  // function are stored there, so anything we can't fit in an immediate is
+  // loaded from there. Without `args_now`, everything is.
+  const int64_t off_record = (int64_t)slot_size - sizeof(thunk_record_t);
+  const int64_t off_args = off_record - 8 * (int64_t)nargs_now;
+  const int64_t off_fn = off_record + offsetof(thunk_record_t, fn);
+
+  if (vcurry_is_frameless(nargs_now, nargs_later, persistent, profile)) {
+    emit_endbr64(e);
+    if (profile != CURRY_PROFILE_OFF)
+      emit_profile_count(e, counters);
+    emit_thunk_later_args(e, nargs_now, nargs_later);
+    for (size_t idst = 0; idst < nargs_now; idst++) {
+      const int64_t pool = off_args + 8 * idst;
+      if (args_now != NULL)
+        emit_mov_reg_imm(e, argidx_to_regid(idst), args_now[idst], pool);
+      else
+        emit_mov_reg_rip(e, argidx_to_regid(idst), pool);
+    }
+    emit_ff_rip(e, FF_OP_JMP, off_fn);
+    return;
+  }
+
+  // Set up the stack frame, then get the later-args out of the way. Thunks that
+  // time their calls keep the start time in the frame.
+  const bool timed = profile == CURRY_PROFILE_CYCLES;
+  emit_thunk_prologue(e, nslots_of(nargs_now + nargs_later), timed);
+  if (profile != CURRY_PROFILE_OFF)
+    emit_profile_count(e, counters);
+  emit_thunk_later_args(e, nargs_now, nargs_later);
+
+  // Finally, place all the now-args by materializing them into registers or the
+  // stack. If there are a lot of now-overflow-args, or if they all have to come
+  // from the record anyway, it's better to copy them out all at once.
+  const bool copy_now = nargs_now >= 6 + COPY_LOOP_MIN ||
+                        (args_now == NULL && nargs_now > 6);
+  if (copy_now) {
+    emit_lea_rip(e, REG_ID_R11, off_args + 8 * 6);
+    emit_copy_block(e, REG_ID_RSP, 0, REG_ID_R11, 0, nargs_now - 6);
+  }
+  for (size_t idst = 0; idst < nargs_now; idst++) {
+    const int64_t pool = off_args + 8 * idst;
+    if (idst < 6 && args_now == NULL) {
+      emit_mov_reg_rip(e, argidx_to_regid(idst), pool);
+    } else if (idst < 6) {
+      emit_mov_reg_imm(e, argidx_to_regid(idst), args_now[idst], pool);
+    } else if (!copy_now) {
+      emit_mov_mem_imm(e, REG_ID_RSP, 8 * (idst - 6), args_now[idst], pool);
+    }
+  }
+
+  // Do the call. We don't know where the destination is, and x86-64 doesn't
+  // have a way to call arbitrary 64-bit addresses. So, we call through the copy
+  // of the address in the record.
+  if (timed)
+    emit_profile_start(e);
+  emit_ff_rip(e, FF_OP_CALL, off_fn);
+  if (timed)
+    emit_profile_stop(e, counters);
+  // Did that call. Now all that's left is to get back to the caller.
+  {
+    // Emit: leave
+    emit_u8(e, 0xc9);
+  }
+
+  // Persistent thunks stay around after the call, so they can just return. The
+  // return value is already in %rax.
+  if (persistent) {
+    // Emit: ret
+    emit_u8(e, 0xc3);
+  }
+
+  // Otherwise, we need to free this slot. We know where it is relative to the
+  // current instruction.
+  else {
+    emit_lea_rip(e, REG_ID_RDI, 0);
+    emit_thunk_self_free(e, rx, false);
+  }
+}
+
+static inline void vcurry_emit_typed_thunk(
+    emitter_t *e, const uint8_t *rx, size_t slot_size, size_t nargs_now,
+    size_t nargs_later, const curry_arg_class_t *classes,
+    const uint64_t *args_now, bool persistent, curry_profile_mode_t profile,
+    curry_profile_counters_t *counters) {
+  // The record is laid out the same way as for any other thunk
+  const int64_t off_record = (int64_t)slot_size - sizeof(thunk_record_t);
+  const int64_t off_args = off_record - 8 * (int64_t)nargs_now;
+  const int64_t off_fn = off_record + offsetof(thunk_record_t, fn);
+
+  // Work out where the function expects each argument, and where each later-arg
+  // is passed to us. Within each kind of register, a later-arg moves up by the
+  // number of now-args of that kind, so it might spill onto the stack, but it
+  // never moves from the stack into a register.
+  arg_loc_t dst[CURRY_MAX_ARGS];
+  arg_loc_t src[CURRY_MAX_ARGS];
+  const size_t nslots = vcurry_classify(classes, nargs_now + nargs_later, dst);
+  vcurry_classify(classes + nargs_now, nargs_later, src);
+
+  // Like with integers, we only need a frame if something goes on the stack or
+  // we have to do something after the call
+  const bool timed = profile == CURRY_PROFILE_CYCLES;
+  const bool frameless = persistent && nslots == 0 && !timed;
+  if (frameless)
+    emit_endbr64(e);
+  else
+    emit_thunk_prologue(e, nslots, timed);
+  if (profile != CURRY_PROFILE_OFF)
+    emit_profile_count(e, counters);
+
+  // Start with the later-args that end up on the stack, while the registers
+  // they might come from are still intact. The ones that were already on the
+  // stack stay in the same order, so runs of them are copied as a block.
+  for (size_t j = 0; j < nargs_later;) {
+    const arg_loc_t to = dst[nargs_now + j];
+    const arg_loc_t from = src[j];
+    size_t run = 1;
+    if (to.kind != ARG_LOC_STACK) {
+      // Handled below
+    } else if (from.kind == ARG_LOC_GPR) {
+      emit_mov_mem_reg(e, REG_ID_RSP, 8 * to.index,
+                       argidx_to_regid(from.index));
+    } else if (from.kind == ARG_LOC_XMM) {
+      emit_movq_mem_xmm(e, REG_ID_RSP, 8 * to.index, from.index);
+    } else {
+      while (j + run < nargs_later && src[j + run].kind == ARG_LOC_STACK)
+        run++;
+      emit_copy_block(e, REG_ID_RSP, 8 * to.index, REG_ID_RBP,
+                      16 + 8 * from.index, run);
+    }
+    j += run;
+  }
+
+  // Then move the later-args that stay in registers. They only move up, so
+  // going in reverse order means we never clobber one that hasn't moved yet.
+  for (size_t j = nargs_later; j-- > 0;) {
+    const arg_loc_t to = dst[nargs_now + j];
+    const arg_loc_t from = src[j];
+    if (to.index == from.index)
+      continue;
+    if (to.kind == ARG_LOC_GPR)
+      emit_mov_reg_reg(e, argidx_to_regid(to.index),
+                       argidx_to_regid(from.index));
+    else if (to.kind == ARG_LOC_XMM)
+      emit_movaps_xmm_xmm(e, to.index, from.index);
+  }
+
+  // Finally, materialize the now-args. There are no immediate forms for XMM
+  // registers, so floating-point arguments are loaded from the record unless
+  // they're zero. Now-args on the stack come first, so they're in the same
+  // order as in the record. Like with integers, long runs of them, or ones
+  // that have to come from the record anyway, are copied as a block.
+  for (size_t i = 0; i < nargs_now;) {
+    const arg_loc_t to = dst[i];
+    const int64_t pool = off_args + 8 * i;
+    size_t run = 1;
+    if (to.kind == ARG_LOC_GPR) {
+      if (args_now != NULL)
+        emit_mov_reg_imm(e, argidx_to_regid(to.index), args_now[i], pool);
+      else
+        emit_mov_reg_rip(e, argidx_to_regid(to.index), pool);
+    } else if (to.kind == ARG_LOC_XMM) {
+      if (args_now != NULL && args_now[i] == 0)
+        emit_xorps_xmm(e, to.index);
+      else
+        emit_movq_xmm_rip(e, to.index, pool);
+    } else {
+      while (i + run < nargs_now && dst[i + run].kind == ARG_LOC_STACK)
+        run++;
+      if (args_now == NULL || run >= COPY_LOOP_MIN) {
+        emit_lea_rip(e, REG_ID_R11, pool);
+        emit_copy_block(e, REG_ID_RSP, 8 * to.index, REG_ID_R11, 0, run);
+      } else {
+        for (size_t k = 0; k < run; k++)
+          emit_mov_mem_imm(e, REG_ID_RSP, 8 * (to.index + k), args_now[i + k],
+                           pool + 8 * k);
+      }
+    }
+    i += run;
+  }
 
-static void vcurry_write_thunk(uint8_t *buf, size_t buf_size, void *fn,
-                               size_t nargs_now, size_t nargs_later,
-                               va_list args_now) {
-  // Compute how many arguments we have in total
+  // The rest is the same as for integers, except the return value might be in
+  // %xmm0 too
+  if (frameless) {
+    emit_ff_rip(e, FF_OP_JMP, off_fn);
+    return;
+  }
+  if (timed)
+    emit_profile_start(e);
+  emit_ff_rip(e, FF_OP_CALL, off_fn);
+  if (timed)
+    emit_profile_stop(e, counters);
+  {
+    // Emit: leave
+    emit_u8(e, 0xc9);
+  }
+  if (persistent) {
+    // Emit: ret
+    emit_u8(e, 0xc3);
+  } else {
+    emit_lea_rip(e, REG_ID_RDI, 0);
+    emit_thunk_self_free(e, rx, true);
+  }
+}
+
+__attribute__((flatten)) static size_t
+vcurry_write_thunk(uint8_t *buf, const uint8_t *rx, size_t slot_size,
+                   size_t nargs_now, size_t nargs_later,
+                   const curry_arg_class_t *classes, const uint64_t *args_now,
+                   bool persistent, curry_profile_mode_t profile,
+                   curry_profile_counters_t *counters) {
+  emitter_t e = {.buf = buf, .pos = 0};
+  if (classes != NULL)
+    vcurry_emit_typed_thunk(&e, rx, slot_size, nargs_now, nargs_later,
+                            classes, args_now, persistent, profile, counters);
+  else
+    vcurry_emit_thunk(&e, rx, slot_size, nargs_now, nargs_later, args_now,
+                      persistent, profile, counters);
+  return e.pos;
+}
+
+__attribute__((flatten)) static size_t
+vcurry_thunk_size(size_t nargs_now, size_t nargs_later,
+                  const curry_arg_class_t *classes, const uint64_t *args_now,
+                  bool persistent, curry_profile_mode_t profile) {
+  emitter_t e = {.buf = NULL, .pos = 0};
+  if (classes != NULL)
+    vcurry_emit_typed_thunk(&e, NULL, 0, nargs_now, nargs_later, classes,
+                            args_now, persistent, profile, NULL);
+  else
+    vcurry_emit_thunk(&e, NULL, 0, nargs_now, nargs_later, args_now,
+                      persistent, profile, NULL);
+  return e.pos;
+}
+
+static size_t vcurry_write_shape(uint8_t *buf, const uint8_t *rx,
+                                 size_t thunk_size, size_t nargs_now,
+                                 size_t nargs_later, bool persistent) {
+  // Create the emitter we'll use to write to the buffer
+  emitter_t emitter = {.buf = buf, .pos = 0};
+  emitter_t *const e = &emitter;
+  // Figure out where the record is relative to the thunk, which is in %r11
+  const int32_t disp_record = thunk_size - sizeof(thunk_record_t);
+  const int32_t disp_args = disp_record - 8 * nargs_now;
+  const int32_t disp_fn = disp_record + offsetof(thunk_record_t, fn);
+
+  // Without a frame, this is just like a normal thunk, except the now-args and
+  // the function come out of the record
+  if (vcurry_is_frameless(nargs_now, nargs_later, persistent,
+                          CURRY_PROFILE_OFF)) {
+    emit_endbr64(e);
+    emit_thunk_later_args(e, nargs_now, nargs_later);
+    for (size_t idst = 0; idst < nargs_now; idst++)
+      emit_mov_reg_mem(e, argidx_to_regid(idst), REG_ID_R11,
+                       disp_args + 8 * idst);
+    emit_ff_mem(e, FF_OP_JMP, REG_ID_R11, disp_fn);
+    return e->pos;
+  }
+
+  // Set up the stack frame. One-shot thunks have to free themselves after the
+  // call, but %r11 won't survive it. So, they keep it in the frame.
+  emit_thunk_prologue(e, nslots_of(nargs_now + nargs_later), !persistent);
+  if (!persistent)
+    emit_mov_mem_reg(e, REG_ID_RBP, -8, REG_ID_R11);
+  emit_thunk_later_args(e, nargs_now, nargs_later);
+
+  // Load the now-args out of the thunk's record
+  for (size_t idst = 0; idst < nargs_now && idst < 6; idst++) {
+    emit_mov_reg_mem(e, argidx_to_regid(idst), REG_ID_R11,
+                     disp_args + 8 * idst);
+  }
+  if (nargs_now > 6) {
+    emit_copy_block(e, REG_ID_RSP, 0, REG_ID_R11, disp_args + 8 * 6,
+                    nargs_now - 6);
+  }
+
+  // Call the function whose address is in the record
+  emit_ff_mem(e, FF_OP_CALL, REG_ID_R11, disp_fn);
+
+  // Get back to the caller, freeing the thunk if we need to
+  if (persistent) {
+    // Emit: leave
+    emit_u8(e, 0xc9);
+    // Emit: ret
+    emit_u8(e, 0xc3);
+  } else {
+    emit_mov_reg_mem(e, REG_ID_RDI, REG_ID_RBP, -8);
+    // Emit: leave
+    emit_u8(e, 0xc9);
+    emit_thunk_self_free(e, rx, false);
+  }
+  return e->pos;
+}
+
+static void vcurry_write_stub(uint8_t *buf, size_t buf_size) {
+  // Create the emitter we'll use to write to the buffer
+  emitter_t emitter = {.buf = buf, .pos = 0};
+  emitter_t *const e = &emitter;
+  emit_endbr64(e);
+  emit_lea_rip(e, REG_ID_R11, 0);
+  {
+    // Emit: jmp [%r11 + $(offset of shape)]
+    // Always use a 32-bit displacement, so every stub is the same size.
+    const int32_t disp = buf_size - sizeof(thunk_record_t) +
+                         offsetof(thunk_record_t, shape);
+    emit_u8(e, 0x41);
+    emit_u8(e, 0xff);
+    emit_u8(e, 0xa3);
+    emit_u32(e, disp);
+  }
+  assert(e->pos <= SHAPE_STUB_SIZE);
+}
+
+static size_t vcurry_write_pipeline(uint8_t *buf, size_t slot_size,
+                                    const pipeline_stage_t *stages,
+                                    size_t nstages, size_t nargs_later) {
+  // Create the emitter we'll use to write to the buffer
+  emitter_t emitter = {.buf = buf, .pos = 0};
+  emitter_t *const e = &emitter;
+
+  // Figure out where everything is in the record, and how many overflow-args
+  // the stages take at most. Every stage after the first takes one argument.
+  size_t npool = nstages;
+  size_t nslots = nslots_of(stages[0].nargs_now + nargs_later);
+  for (size_t i = 0; i < nstages; i++) {
+    npool += stages[i].nargs_now;
+    if (i != 0 && nslots_of(stages[i].nargs_now + 1) > nslots)
+      nslots = nslots_of(stages[i].nargs_now + 1);
+  }
+  const int64_t off_record = (int64_t)slot_size - sizeof(thunk_record_t);
+  const int64_t off_fns = off_record - 8 * (int64_t)nstages;
+  int64_t off_args = off_record - 8 * (int64_t)npool;
+
+  // Every stage but the last is called, so we always need a frame. The same
+  // space is reused for each stage's overflow-args.
+  emit_thunk_prologue(e, nslots, false);
+  for (size_t i = 0; i < nstages; i++) {
+    const pipeline_stage_t *const stage = &stages[i];
+    const size_t nargs_now = stage->nargs_now;
+
+    // The first stage gets the later-args, and every other stage gets the
+    // result of the one before it. That goes in first, since materializing the
+    // now-args might clobber %rax.
+    size_t nargs_total = nargs_now + 1;
+    if (i == 0) {
+      emit_thunk_later_args(e, nargs_now, nargs_later);
+      nargs_total = nargs_now + nargs_later;
+    } else if (nargs_now < 6) {
+      emit_mov_reg_reg(e, argidx_to_regid(nargs_now), REG_ID_RAX);
+    } else {
+      emit_mov_mem_reg(e, REG_ID_RSP, 8 * (nargs_now - 6), REG_ID_RAX);
+    }
+    for (size_t idst = 0; idst < nargs_now; idst++) {
+      const int64_t pool = off_args + 8 * idst;
+      if (idst < 6)
+        emit_mov_reg_imm(e, argidx_to_regid(idst), stage->args_now[idst],
+                         pool);
+      else
+        emit_mov_mem_imm(e, REG_ID_RSP, 8 * (idst - 6), stage->args_now[idst],
+                         pool);
+    }
+    off_args += 8 * (int64_t)nargs_now;
+
+    // If the last stage doesn't need anything on the stack, we can tear down
+    // the frame and jump to it. It returns straight to our caller.
+    if (i == nstages - 1 && nslots_of(nargs_total) == 0) {
+      // Emit: leave
+      emit_u8(e, 0xc9);
+      emit_ff_rip(e, FF_OP_JMP, off_fns + 8 * (int64_t)i);
+      return e->pos;
+    }
+    emit_ff_rip(e, FF_OP_CALL, off_fns + 8 * (int64_t)i);
+  }
+
+  // The last stage's result is already in %rax
+  {
+    // Emit: leave
+    emit_u8(e, 0xc9);
+    // Emit: ret
+    emit_u8(e, 0xc3);
+  }
+  return e->pos;
+}
+
+static size_t vcurry_write_apply(uint8_t *buf, size_t slot_size,
+                                 size_t nargs_now, size_t nargs_later,
+                                 const uint64_t *pool, bool store) {
+  // Create the emitter we'll use to write to the buffer
+  emitter_t emitter = {.buf = buf, .pos = 0};
+  emitter_t *const e = &emitter;
+  // Figure out where everything is in the pool
+  const int64_t off_args =
+      (int64_t)slot_size - 8 * (int64_t)(nargs_now + APPLY_POOL_EXTRA);
+  const int64_t off_fn = off_args + 8 * (int64_t)nargs_now;
+  const int64_t off_rows = off_fn + 8;
+  const int64_t off_results = off_fn + 16;
+  const int64_t off_nrows = off_fn + 24;
+
+  // The loop keeps its state in callee-saved registers, so it survives the
+  // calls. %rbx points to the current row, %r12 to the current result, and
+  // %r13 counts down the rows. Their old values are saved in the frame, above
+  // the overflow-args.
   const size_t nargs_total = nargs_now + nargs_later;
-  // Create a pointer we'll use to iterate over the buffer
-  uint8_t *cur = buf;
+  emit_thunk_prologue(e, nslots_of(nargs_total) + 3, false);
+  emit_mov_mem_reg(e, REG_ID_RBP, -8, REG_ID_RBX);
+  emit_mov_mem_reg(e, REG_ID_RBP, -16, REG_ID_R12);
+  emit_mov_mem_reg(e, REG_ID_RBP, -24, REG_ID_R13);
+  emit_mov_reg_imm(e, REG_ID_RBX, pool[nargs_now + 1], off_rows);
+  if (store)
+    emit_mov_reg_imm(e, REG_ID_R12, pool[nargs_now + 2], off_results);
+  emit_mov_reg_imm(e, REG_ID_R13, pool[nargs_now + 3], off_nrows);
 
-  // It's possible that we're running with CET enabled. Like GCC, we need to
-  // emit an `endbr64` as our first instruction.
+  // Fill in the overflow-args first, since that clobbers scratch registers.
+  // They're filled in again for every row, since the function is allowed to
+  // overwrite them. The later-args come from the row, and the now-args are
+  // materialized the same way as in a thunk.
+  const size_t loop = e->pos;
+  if (nargs_total > 6) {
+    const size_t ifirst = nargs_now > 6 ? nargs_now : 6;
+    emit_copy_block(e, REG_ID_RSP, 8 * (ifirst - 6), REG_ID_RBX,
+                    8 * (ifirst - nargs_now), nargs_total - ifirst);
+  }
+  const bool copy_now = nargs_now >= 6 + COPY_LOOP_MIN;
+  if (copy_now) {
+    emit_lea_rip(e, REG_ID_R11, off_args + 8 * 6);
+    emit_copy_block(e, REG_ID_RSP, 0, REG_ID_R11, 0, nargs_now - 6);
+  }
+  for (size_t idst = 6; idst < nargs_now && !copy_now; idst++) {
+    emit_mov_mem_imm(e, REG_ID_RSP, 8 * (idst - 6), pool[idst],
+                     off_args + 8 * idst);
+  }
+  // Then the register args
+  for (size_t idst = nargs_now; idst < nargs_total && idst < 6; idst++) {
+    emit_mov_reg_mem(e, argidx_to_regid(idst), REG_ID_RBX,
+                     8 * (idst - nargs_now));
+  }
+  for (size_t idst = 0; idst < nargs_now && idst < 6; idst++) {
+    emit_mov_reg_imm(e, argidx_to_regid(idst), pool[idst],
+                     off_args + 8 * idst);
+  }
+
+  // Call the function, and move on to the next row
+  emit_ff_rip(e, FF_OP_CALL, off_fn);
+  if (store) {
+    emit_mov_mem_reg(e, REG_ID_R12, 0, REG_ID_RAX);
+    {
+      // Emit: add %r12, 8
+      emit_u8(e, 0x49);
+      emit_u8(e, 0x83);
+      emit_u8(e, 0xc4);
+      emit_u8(e, 0x08);
+    }
+  }
+  if (nargs_later == 0) {
+    // Every row is empty
+  } else if (8 * nargs_later < 128) {
+    // Emit: add %rbx, $(8 * nargs_later)
+    emit_u8(e, 0x48);
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xc3);
+    emit_u8(e, 8 * nargs_later);
+  } else {
+    // Emit: add %rbx, $(8 * nargs_later)
+    emit_u8(e, 0x48);
+    emit_u8(e, 0x81);
+    emit_u8(e, 0xc3);
+    emit_u32(e, 8 * nargs_later);
+  }
+  {
+    // Emit: dec %r13
+    emit_u8(e, 0x49);
+    emit_u8(e, 0xff);
+    emit_u8(e, 0xcd);
+  }
   {
-    // Emit: endbr64
-    *cur++ = 0xf3;
-    *cur++ = 0x0f;
-    *cur++ = 0x1e;
-    *cur++ = 0xfa;
+    // Emit: jnz $(loop)
+    // The loop can be too long for an 8-bit displacement
+    const int64_t rel = (int64_t)loop - (int64_t)(e->pos + 6);
+    emit_u8(e, 0x0f);
+    emit_u8(e, 0x85);
+    emit_u32(e, rel);
   }
 
-  // Allocate space on the stack for overflow args. This also pushes the base
-  // pointer onto the stack, which gives us the required alignment. For
+  // Restore the registers we used, and return
+  emit_mov_reg_mem(e, REG_ID_RBX, REG_ID_RBP, -8);
+  emit_mov_reg_mem(e, REG_ID_R12, REG_ID_RBP, -16);
+  emit_mov_reg_mem(e, REG_ID_R13, REG_ID_RBP, -24);
+  {
+    // Emit: leave
+    emit_u8(e, 0xc9);
+    // Emit: ret
+    emit_u8(e, 0xc3);
+  }
+  return e->pos;
+}
+
+static void emit_thunk_prologue(emitter_t *e, size_t nslots, bool save_slot) {
+  emit_endbr64(e);
+
+  // Push the base pointer and allocate space on the stack for overflow args.
+  // This is what `enter` does, but `enter` is microcoded and much slower. For
   // alignment, we can have an even number of slots in addition to the base
-  // pointer.
+  // pointer. If we need a save slot, we add two so the alignment stays the
+  // same.
+  const size_t slots_padded =
+      (nslots % 2 == 1 ? nslots + 1 : nslots) + (save_slot ? 2 : 0);
+  const size_t bytes_padded = 8 * slots_padded;
+  assert(bytes_padded % 16 == 0 && "Stack misaligned");
+  assert(is_i32(bytes_padded) && "Too many overflow-args");
   {
-    const size_t slots_overflow = nargs_total > 6 ? nargs_total - 6 : 0;
-    const size_t slots_padded =
-        slots_overflow % 2 == 1 ? slots_overflow + 1 : slots_overflow;
-    const size_t bytes_padded = 8 * slots_padded;
-    assert(bytes_padded % 16 == 0 && "Stack misaligned");
-    assert(bytes_padded < UINT32_C(0x10000) && "Too many overflow-args");
-    // Emit: enter $(bytes_padded), 0
-    // Pushes bytes_padded + 8 bytes onto the stack
-    *cur++ = 0xc8;
-    *((uint16_t *)cur) = bytes_padded;
-    cur += 2;
-    *cur++ = 0x00;
+    // Emit: push %rbp
+    emit_u8(e, 0x55);
   }
+  emit_mov_reg_reg(e, REG_ID_RBP, REG_ID_RSP);
+  if (bytes_padded == 0) {
+    // Nothing to allocate
+  } else if (bytes_padded < 128) {
+    // Emit: sub %rsp, $(bytes_padded)
+    // The 8-bit immediate is sign-extended
+    emit_u8(e, 0x48);
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xec);
+    emit_u8(e, bytes_padded);
+  } else {
+    // Emit: sub %rsp, $(bytes_padded)
+    emit_u8(e, 0x48);
+    emit_u8(e, 0x81);
+    emit_u8(e, 0xec);
+    emit_u32(e, bytes_padded);
+  }
+}
 
+static void emit_thunk_later_args(emitter_t *e, size_t nargs_now,
+                                  size_t nargs_later) {
   // Place all the later-reg-args in the right place
   const size_t nargs_later_reg = nargs_later > 6 ? 6 : nargs_later;
   for (size_t i = 0; i < nargs_later_reg; i++) {
@@ -152,94 +1675,59 @@ static void vcurry_write_thunk(uint8_t *buf, size_t buf_size, void *fn,
     if (idst < 6) {
       // The target is a register
       reg_id_t rid_dst = argidx_to_regid(idst);
-      cur = emit_mov_reg_reg(cur, rid_dst, rid_src);
+      emit_mov_reg_reg(e, rid_dst, rid_src);
     } else {
       // The target is on the stack
-      cur = emit_mov_rsp_reg(cur, idst - 6, rid_src);
+      emit_mov_mem_reg(e, REG_ID_RSP, 8 * (idst - 6), rid_src);
     }
   }
 
-  // All of the later-overflow-args need to be copied from the stack
-  for (size_t isrc = 6; isrc < nargs_later; isrc++) {
-    cur = emit_mov_reg_rbp(cur, REG_ID_RAX, isrc - 6);
-    cur = emit_mov_rsp_reg(cur, nargs_now + isrc - 6, REG_ID_RAX);
+  // All of the later-overflow-args need to be copied from the stack. They
+  // start just past the saved base pointer and the return address.
+  if (nargs_later > 6) {
+    emit_copy_block(e, REG_ID_RSP, 8 * nargs_now, REG_ID_RBP, 16,
+                    nargs_later - 6);
   }
+}
 
-  // Finally, place all the now-args by materializing them into registers or the
-  // stack.
-  for (size_t idst = 0; idst < nargs_now; idst++) {
-    // Fetch the immediate to materialize
-    const uint64_t arg = va_arg(args_now, uint64_t);
-    // Materialize it
-    if (idst < 6) {
-      // The argument goes into a register
-      reg_id_t rid_dst = argidx_to_regid(idst);
-      cur = emit_mov_reg_imm(cur, rid_dst, arg);
-    } else {
-      cur = emit_mov_reg_imm(cur, REG_ID_RAX, arg);
-      cur = emit_mov_rsp_reg(cur, idst - 6, REG_ID_RAX);
-    }
-  }
+static void emit_thunk_self_free(emitter_t *e, const uint8_t *rx, bool sse) {
+  // The return value is in %rax, but we need to free this slot. So, push the
+  // return value onto the stack, free ourselves, and have the call return to a
+  // trampoline that restores the return value before returning. Of course, the
+  // trampoline has to be statically allocated so we don't have to free it.
+  // Additionally, the trampoline cannot rely on the stack to be aligned 8 mod
+  // 16. In fact, it will be aligned 0 mod 16.
+  //
+  // The addresses of the trampoline and of `vcurry_release` are at the start of
+  // this chunk. We only need their offsets from this code.
+  const void *const *const constants = curry_slab_constants_of(rx);
+  const int64_t off_trampoline =
+      (uintptr_t)&constants[sse ? CONSTANT_TRAMPOLINE_SSE
+                                : CONSTANT_TRAMPOLINE] -
+      (uintptr_t)rx;
+  const int64_t off_release =
+      (uintptr_t)&constants[CONSTANT_RELEASE] - (uintptr_t)rx;
 
-  // Do the call. We don't know where the destination is, and x86-64 doesn't
-  // have a way to call arbitrary 64-bit addresses. Thus, we have to materialize
-  // the callsite into a register, then emit an indirect call.
-  cur = emit_mov_reg_imm(cur, REG_ID_RAX, (uint64_t)fn);
-  {
-    // Emit: call %rax
-    *cur++ = 0xff;
-    *cur++ = 0xd0;
-  }
-  // Did that call. Now all that's left is to get back to the caller.
+  // Save the return value
   {
-    // Emit: leave
-    *cur++ = 0xc9;
+    // Emit: push %rax
+    emit_u8(e, 0x50);
   }
-
-  // Currently, the return value is in %rax. We need to free this buffer though.
-  // So, push the return value onto the stack, free ourselves, and have the call
-  // return to a trampoline that restores the return value before returning. Of
-  // course, the trampoline has to be statically allocated so we don't have to
-  // free it. Additionally, the trampoline cannot rely on the stack to be
-  // aligned 8 mod 16. In fact, it will be aligned 0 mod 16.
-  {
-    // Save the return value
-    {
-      // Emit: push %rax
-      *cur++ = 0x50;
-    }
-    // Create a fake return address for `munmap` to return from
-    {
-      // Emit: mov %rax, $(vcurry_return_trampoline)
-      cur = emit_mov_reg_imm(cur, REG_ID_RAX,
-                             (uint64_t)&vcurry_return_trampoline);
-      // Emit: push %rax
-      *cur++ = 0x50;
-    }
-    // Setup arguments for `munmap`
-    {
-      // Emit: lea %rdi, $(buf)
-      *cur++ = 0x48;
-      *cur++ = 0x8d;
-      *cur++ = 0x35;
-      *((int32_t *)cur) = (int32_t)(buf - (cur + 4));
-      cur += 4;
-      assert(is_i32(buf - (cur + 4)) && "Offset too large for lea");
-      // Emit: mov %rsi, $(buf_size)
-      cur = emit_mov_reg_imm(cur, REG_ID_RSI, buf_size);
-    }
-    // Call `munmap`
-    {
-      // Emit: mov %rax, $(munmap)
-      cur = emit_mov_reg_imm(cur, REG_ID_RAX, (uint64_t)munmap);
-      // Emit: jmp *%rax
-      *cur++ = 0xff;
-      *cur++ = 0xe0;
-    }
+  // The other trampoline expects %xmm0 below that, padded to 16 bytes so the
+  // stack is still aligned the same way for `vcurry_release`
+  if (sse) {
+    // Emit: sub %rsp, 16
+    emit_u8(e, 0x48);
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xec);
+    emit_u8(e, 0x10);
+    emit_movq_mem_xmm(e, REG_ID_RSP, 0, 0);
   }
-
-  // Make sure we didn't overrun the buffer
-  assert((size_t)(cur - buf) <= buf_size);
+  // Create a fake return address for `vcurry_release` to return from
+  emit_ff_rip(e, FF_OP_PUSH, off_trampoline);
+  // Return the slot to the allocator. Once we jump, this thunk's code is never
+  // touched again, so it's fine for the slot to be reused immediately.
+  emit_ff_rip(e, FF_OP_JMP, off_release);
 }
 
 static reg_id_t argidx_to_regid(size_t argidx) {
@@ -251,109 +1739,412 @@ static reg_id_t argidx_to_regid(size_t argidx) {
   return lut[argidx];
 }
 
-static uint8_t *emit_mov_reg_reg(uint8_t *cur, reg_id_t dst, reg_id_t src) {
+static void emit_u8(emitter_t *e, uint8_t x) {
+  if (e->buf != NULL)
+    e->buf[e->pos] = x;
+  e->pos += 1;
+}
+
+static void emit_u32(emitter_t *e, uint32_t x) {
+  if (e->buf != NULL)
+    memcpy(e->buf + e->pos, &x, sizeof(x));
+  e->pos += sizeof(x);
+}
+
+// Emit a REX prefix, but only if it's needed. The `reg` and `base` are the
+// registers in the ModR/M byte, or in the opcode for `base`.
+static void emit_rex(emitter_t *e, bool wide, reg_id_t reg, reg_id_t base) {
+  const uint8_t rex = (wide ? 0x08 : 0) | ((reg >> 3) & 1) << 2 |
+                      ((base >> 3) & 1) << 0;
+  if (rex != 0)
+    emit_u8(e, 0x40 | rex);
+}
+
+// Emit the ModR/M byte, and whatever follows it, for a memory operand of the
+// form [$(base) + $(disp)]. The caller handles the prefix and opcode.
+static void emit_modrm_mem(emitter_t *e, uint8_t reg, reg_id_t base,
+                           int32_t disp) {
+  // We can omit the displacement if it's zero, except with %rbp and %r13 as the
+  // base. Those encodings mean something else.
+  uint8_t mod;
+  if (disp == 0 && (base & 7) != REG_ID_RBP)
+    mod = 0;
+  else if (disp >= -128 && disp < 128)
+    mod = 1;
+  else
+    mod = 2;
+  emit_u8(e, mod << 6 | (reg & 7) << 3 | (base & 7));
+  // Using %rsp or %r12 as the base requires a SIB byte
+  if ((base & 7) == REG_ID_RSP)
+    emit_u8(e, 0x24);
+  if (mod == 1)
+    emit_u8(e, (int8_t)disp);
+  else if (mod == 2)
+    emit_u32(e, disp);
+}
+
+// Emit the ModR/M byte and displacement for a memory operand of the form
+// [%rip + $(disp)], where the displacement is computed so the operand refers
+// to `target`. This has to come last in the instruction, since the
+// displacement is relative to the end of it.
+static void emit_modrm_rip(emitter_t *e, uint8_t reg, int64_t target) {
+  emit_u8(e, (reg & 7) << 3 | 0x05);
+  const int64_t disp = target - (int64_t)(e->pos + 4);
+  assert((e->buf == NULL || is_i32(disp)) && "Offset too large for %rip");
+  emit_u32(e, disp);
+}
+
+static void emit_endbr64(emitter_t *e) {
+  // It's possible that we're running with CET enabled. Like GCC, we need to
+  // emit an `endbr64` as the first instruction of anything called indirectly.
+  // If we know indirect branch tracking is off, it would just take up space.
+  if (!codegen.endbr)
+    return;
+  emit_u8(e, 0xf3);
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0x1e);
+  emit_u8(e, 0xfa);
+}
+
+static void emit_mov_reg_reg(emitter_t *e, reg_id_t dst, reg_id_t src) {
   // Here, the r/m64 is the destination, and the r64 is the source
-  *cur++ = 0x48 | ((src >> 3) & 1) << 2 | ((dst >> 3) & 1) << 0;
-  *cur++ = 0x89;
-  *cur++ = 0xc0 | (src & 7) << 3 | (dst & 7) << 0;
-  return cur;
-}
-
-static uint8_t *emit_mov_rsp_reg(uint8_t *cur, size_t slot, reg_id_t src) {
-  // We have different encodings depending on whether the slot's offset fits
-  // within an 8-bit signed integer. We can also optimize if the offset is zero.
-  bool zero_encoding = slot == 0;
-  bool small_encoding = slot < 128 / 8;
-  assert(slot < UINT32_C(0x0fffffff) && "Slot too large");
-  // The prefix is always the same. We encode the source register. The base
-  // register is always %rsp, and we never have an index.
-  *cur++ = 0x48 | ((src >> 3) & 1) << 2;
-  *cur++ = 0x89;
-  if (zero_encoding) {
-    *cur++ = 0x04 | (src & 7) << 3;
-    *cur++ = 0x24;
-  } else if (small_encoding) {
-    assert(8 * slot < 128);
-    *cur++ = 0x44 | (src & 7) << 3;
-    *cur++ = 0x24;
-    *cur++ = 8 * slot;
-  } else {
-    *cur++ = 0x84 | (src & 7) << 3;
-    *cur++ = 0x24;
-    *((int32_t *)cur) = 8 * slot;
-    cur += 4;
-  }
-  return cur;
-}
-
-static uint8_t *emit_mov_reg_rbp(uint8_t *cur, reg_id_t dst, size_t slot) {
-  // Compute the byte offset to which we will store. Note that this will never
-  // be zero since we skip over the saved base pointer and the return address.
-  const size_t offset = 16 + 8 * slot;
-  assert(slot < UINT32_C(0x0fffffff) && "Slot too large");
-  // We have different encodings depending on whether the offset fits within an
-  // 8-bit signed integer.
-  bool small_encoding = offset < 128;
-  // The prefix is always the same. We encode the source register. The base
-  // register is always %rbp, and we never have an index.
-  *cur++ = 0x48 | ((dst >> 3) & 1) << 2;
-  *cur++ = 0x8b;
-  if (small_encoding) {
-    *cur++ = 0x45 | (dst & 7) << 3;
-    *cur++ = offset;
-  } else {
-    *cur++ = 0x85 | (dst & 7) << 3;
-    *((int32_t *)cur) = offset;
-    cur += 4;
-  }
-  return cur;
-}
-
-static uint8_t *emit_mov_reg_imm(uint8_t *cur, reg_id_t dst, uint64_t imm) {
-  // TODO: Optimize. There are are lot of ways to materialize immediates into
-  // registers. Ideally, we'd pick the best one.
-  if ((dst & 8) == 0 && is_u32(imm)) {
-    // If we're using a 32-bit register (high bit clear) and the immediate is
-    // unsigned 32-bit, then we can use a shorter encoding.
-    *cur++ = 0xb8 | (dst & 7);
-    *((uint32_t *)cur) = imm & UINT32_C(0xffffffff);
-    cur += 4;
+  emit_rex(e, true, src, dst);
+  emit_u8(e, 0x89);
+  emit_u8(e, 0xc0 | (src & 7) << 3 | (dst & 7) << 0);
+}
+
+static void emit_mov_reg_imm(emitter_t *e, reg_id_t dst, uint64_t imm,
+                             int64_t pool) {
+  if (imm == 0) {
+    // Emit: xor $(dst:32), $(dst:32)
+    // Writing the 32-bit register clears the upper half
+    emit_rex(e, false, dst, dst);
+    emit_u8(e, 0x31);
+    emit_u8(e, 0xc0 | (dst & 7) << 3 | (dst & 7));
+  } else if (imm == UINT64_MAX) {
+    // Emit: or $(dst), -1
+    // The 8-bit immediate is sign-extended, so every bit gets set
+    emit_rex(e, true, 0, dst);
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xc8 | (dst & 7));
+    emit_u8(e, 0xff);
+  } else if (is_u32(imm)) {
+    // Emit: mov $(dst:32), $(imm)
+    emit_rex(e, false, 0, dst);
+    emit_u8(e, 0xb8 | (dst & 7));
+    emit_u32(e, imm);
   } else if (is_i32(imm)) {
-    // Otherwise, if the immediate is signed 32-bit
-    *cur++ = 0x48 | ((dst >> 3) & 1) << 0;
-    *cur++ = 0xc7;
-    *cur++ = 0xc0 | (dst & 7);
-    *((uint32_t *)cur) = imm & UINT32_C(0xffffffff);
-    cur += 4;
+    // Emit: mov $(dst), $(imm)
+    // The 32-bit immediate is sign-extended
+    emit_rex(e, true, 0, dst);
+    emit_u8(e, 0xc7);
+    emit_u8(e, 0xc0 | (dst & 7));
+    emit_u32(e, imm);
   } else {
-    // Just use the long encoding
-    *cur++ = 0x48 | ((dst >> 3) & 1) << 0;
-    *cur++ = 0xb8 | (dst & 7);
-    *((uint64_t *)cur) = imm;
-    cur += 8;
-  }
-  return cur;
-}
-
-static size_t vcurry_estimate_thunk_size(size_t nargs_now, size_t nargs_later) {
-  size_t ret = 0;
-  // Entry stuff
-  ret += 4; // endbr64
-  ret += 4; // enter $(bytes_total), 0
-  // Setting up the arguments
-  ret += (8 + 7) * nargs_later;
-  ret += (10 + 8) * nargs_now;
-  // Calling
-  ret += 10; // mov %rax, $(fn)
-  ret += 2;  // call %rax
-  // Exit stuff
-  ret += 1;  // leave
-  ret += 1;  // push %rax
-  ret += 10; // mov %rax, $(vcurry_return_trampoline)
-  ret += 1;  // push %rax
-  ret += 7;  // lea %rdi, [%rip + $(cur - buf)]
-  ret += 10; // mov %rsi, $(buf_size)
-  ret += 10; // mov %rax, $(munmap)
-  ret += 2;  // jmp %rax
-  return ret;
+    // Loading from the pool is shorter than a 64-bit immediate
+    emit_mov_reg_rip(e, dst, pool);
+  }
+}
+
+static void emit_mov_mem_imm(emitter_t *e, reg_id_t base, int32_t disp,
+                             uint64_t imm, int64_t pool) {
+  if (is_i32(imm)) {
+    // Emit: mov qword [$(base) + $(disp)], $(imm)
+    // The 32-bit immediate is sign-extended
+    emit_rex(e, true, 0, base);
+    emit_u8(e, 0xc7);
+    emit_modrm_mem(e, 0, base, disp);
+    emit_u32(e, imm);
+  } else {
+    emit_mov_reg_rip(e, REG_ID_RAX, pool);
+    emit_mov_mem_reg(e, base, disp, REG_ID_RAX);
+  }
+}
+
+static void emit_mov_reg_mem(emitter_t *e, reg_id_t dst, reg_id_t base,
+                             int32_t disp) {
+  emit_rex(e, true, dst, base);
+  emit_u8(e, 0x8b);
+  emit_modrm_mem(e, dst, base, disp);
+}
+
+static void emit_mov_mem_reg(emitter_t *e, reg_id_t base, int32_t disp,
+                             reg_id_t src) {
+  emit_rex(e, true, src, base);
+  emit_u8(e, 0x89);
+  emit_modrm_mem(e, src, base, disp);
+}
+
+static void emit_mov_reg_rip(emitter_t *e, reg_id_t dst, int64_t target) {
+  emit_rex(e, true, dst, 0);
+  emit_u8(e, 0x8b);
+  emit_modrm_rip(e, dst, target);
+}
+
+static void emit_lea_rip(emitter_t *e, reg_id_t dst, int64_t target) {
+  emit_rex(e, true, dst, 0);
+  emit_u8(e, 0x8d);
+  emit_modrm_rip(e, dst, target);
+}
+
+static void emit_ff_mem(emitter_t *e, ff_op_t op, reg_id_t base, int32_t disp) {
+  // The operation is always 64-bit, so the REX prefix is only needed for the
+  // high registers
+  emit_rex(e, false, 0, base);
+  emit_u8(e, 0xff);
+  emit_modrm_mem(e, op, base, disp);
+}
+
+static void emit_ff_rip(emitter_t *e, ff_op_t op, int64_t target) {
+  emit_u8(e, 0xff);
+  emit_modrm_rip(e, op, target);
+}
+
+// Emit the ModR/M and SIB bytes, and whatever follows them, for a memory
+// operand of the form [$(base) + 8 * $(index) + $(disp)]
+static void emit_modrm_idx(emitter_t *e, uint8_t reg, reg_id_t base,
+                           reg_id_t index, int32_t disp) {
+  // Same rules for the displacement as `emit_modrm_mem`
+  uint8_t mod;
+  if (disp == 0 && (base & 7) != REG_ID_RBP)
+    mod = 0;
+  else if (disp >= -128 && disp < 128)
+    mod = 1;
+  else
+    mod = 2;
+  emit_u8(e, mod << 6 | (reg & 7) << 3 | 0x04);
+  emit_u8(e, 0xc0 | (index & 7) << 3 | (base & 7));
+  if (mod == 1)
+    emit_u8(e, (int8_t)disp);
+  else if (mod == 2)
+    emit_u32(e, disp);
+}
+
+// Emit: vmovdqu %ymm15, [$(base) + 8 * $(index) + $(disp)]
+// Or the other way around, if `load` is set. This always uses the three-byte
+// VEX prefix, since the two-byte one can't extend the index or base.
+static void emit_vmovdqu_ymm15(emitter_t *e, bool load, reg_id_t base,
+                               reg_id_t index, int32_t disp) {
+  // The extension bits are inverted. %ymm15 always needs its bit, so that one
+  // is always clear. The rest of the prefix selects the 0f opcode map, no
+  // second source, 256-bit vectors, and an implied f3 prefix.
+  emit_u8(e, 0xc4);
+  emit_u8(e, ((index >> 3) & 1 ? 0 : 0x40) | ((base >> 3) & 1 ? 0 : 0x20) |
+                 0x01);
+  emit_u8(e, 0x7e);
+  emit_u8(e, load ? 0x6f : 0x7f);
+  emit_modrm_idx(e, 15, base, index, disp);
+}
+
+// Like `emit_copy_block` for long blocks, but copying 32 bytes at a time
+static void emit_copy_block_avx(emitter_t *e, reg_id_t dst, int32_t dst_disp,
+                                reg_id_t src, int32_t src_disp, size_t count) {
+  // Copy the odd slots at the end one at a time, so the loop only has to deal
+  // with whole vectors
+  const size_t count_vec = count & ~(size_t)3;
+  for (size_t i = count_vec; i < count; i++) {
+    emit_mov_reg_mem(e, REG_ID_RAX, src, src_disp + 8 * i);
+    emit_mov_mem_reg(e, dst, dst_disp + 8 * i, REG_ID_RAX);
+  }
+
+  // Then copy from the last vector down to the first, counting %r10 down by
+  // four slots at a time
+  emit_mov_reg_imm(e, REG_ID_R10, count_vec, 0);
+  const size_t loop = e->pos;
+  emit_vmovdqu_ymm15(e, true, src, REG_ID_R10, src_disp - 32);
+  emit_vmovdqu_ymm15(e, false, dst, REG_ID_R10, dst_disp - 32);
+  {
+    // Emit: sub %r10, 4
+    emit_u8(e, 0x49);
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xea);
+    emit_u8(e, 0x04);
+  }
+  {
+    // Emit: jnz $(loop)
+    const int64_t rel = (int64_t)loop - (int64_t)(e->pos + 2);
+    assert(rel >= -128 && rel < 0);
+    emit_u8(e, 0x75);
+    emit_u8(e, (int8_t)rel);
+  }
+  {
+    // Emit: vzeroupper
+    // Leaving the upper halves dirty would slow down any SSE code the function
+    // runs. This doesn't touch the lower halves, where arguments are passed.
+    emit_u8(e, 0xc5);
+    emit_u8(e, 0xf8);
+    emit_u8(e, 0x77);
+  }
+}
+
+static void emit_copy_block(emitter_t *e, reg_id_t dst, int32_t dst_disp,
+                            reg_id_t src, int32_t src_disp, size_t count) {
+  if (count < COPY_LOOP_MIN) {
+    for (size_t i = 0; i < count; i++) {
+      emit_mov_reg_mem(e, REG_ID_RAX, src, src_disp + 8 * i);
+      emit_mov_mem_reg(e, dst, dst_disp + 8 * i, REG_ID_RAX);
+    }
+    return;
+  }
+
+  if (codegen.avx_copy) {
+    emit_copy_block_avx(e, dst, dst_disp, src, src_disp, count);
+    return;
+  }
+
+  // Copy from the last slot down to the first, counting %r10 down to zero. We
+  // can't use `rep movsq` since it takes its operands in argument registers.
+  emit_mov_reg_imm(e, REG_ID_R10, count, 0);
+  const size_t loop = e->pos;
+  {
+    // Emit: mov %rax, [$(src) + 8 * %r10 + $(src_disp) - 8]
+    emit_u8(e, 0x48 | 0x02 | ((src >> 3) & 1));
+    emit_u8(e, 0x8b);
+    emit_modrm_idx(e, REG_ID_RAX, src, REG_ID_R10, src_disp - 8);
+  }
+  {
+    // Emit: mov [$(dst) + 8 * %r10 + $(dst_disp) - 8], %rax
+    emit_u8(e, 0x48 | 0x02 | ((dst >> 3) & 1));
+    emit_u8(e, 0x89);
+    emit_modrm_idx(e, REG_ID_RAX, dst, REG_ID_R10, dst_disp - 8);
+  }
+  {
+    // Emit: dec %r10
+    emit_u8(e, 0x49);
+    emit_u8(e, 0xff);
+    emit_u8(e, 0xca);
+  }
+  {
+    // Emit: jnz $(loop)
+    const int64_t rel = (int64_t)loop - (int64_t)(e->pos + 2);
+    assert(rel >= -128 && rel < 0);
+    emit_u8(e, 0x75);
+    emit_u8(e, (int8_t)rel);
+  }
+}
+
+// Emit: mov $(dst), $(imm)
+// This always uses the full 64-bit immediate
+static void emit_movabs(emitter_t *e, reg_id_t dst, uint64_t imm) {
+  emit_rex(e, true, 0, dst);
+  emit_u8(e, 0xb8 | (dst & 7));
+  emit_u32(e, imm);
+  emit_u32(e, imm >> 32);
+}
+
+// Emit code to read the time stamp counter into %rax. This clobbers %rdx.
+static void emit_rdtsc(emitter_t *e) {
+  // Emit: rdtsc
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0x31);
+  // Emit: shl %rdx, 32
+  emit_u8(e, 0x48);
+  emit_u8(e, 0xc1);
+  emit_u8(e, 0xe2);
+  emit_u8(e, 0x20);
+  // Emit: or %rax, %rdx
+  emit_u8(e, 0x48);
+  emit_u8(e, 0x09);
+  emit_u8(e, 0xd0);
+}
+
+static void emit_profile_count(emitter_t *e,
+                               curry_profile_counters_t *counters) {
+  // Other threads might be calling thunks with the same counters, so the
+  // increment has to be atomic
+  emit_movabs(e, REG_ID_R11, (uintptr_t)counters);
+  {
+    // Emit: lock inc qword [%r11 + $(offset of calls)]
+    emit_u8(e, 0xf0);
+    emit_rex(e, true, 0, REG_ID_R11);
+    emit_u8(e, 0xff);
+    emit_modrm_mem(e, 0, REG_ID_R11,
+                   offsetof(curry_profile_counters_t, calls));
+  }
+}
+
+static void emit_profile_start(emitter_t *e) {
+  // The arguments are all in place, and %rdx is one of them
+  emit_mov_reg_reg(e, REG_ID_R11, REG_ID_RDX);
+  emit_rdtsc(e);
+  emit_mov_mem_reg(e, REG_ID_RBP, -8, REG_ID_RAX);
+  emit_mov_reg_reg(e, REG_ID_RDX, REG_ID_R11);
+}
+
+static void emit_profile_stop(emitter_t *e,
+                              curry_profile_counters_t *counters) {
+  // Functions can return in both %rax and %rdx
+  emit_mov_reg_reg(e, REG_ID_R10, REG_ID_RAX);
+  emit_mov_reg_reg(e, REG_ID_R11, REG_ID_RDX);
+  emit_rdtsc(e);
+  {
+    // Emit: sub %rax, [%rbp - 8]
+    emit_rex(e, true, REG_ID_RAX, REG_ID_RBP);
+    emit_u8(e, 0x2b);
+    emit_modrm_mem(e, REG_ID_RAX, REG_ID_RBP, -8);
+  }
+  emit_movabs(e, REG_ID_RDX, (uintptr_t)counters);
+  {
+    // Emit: lock add [%rdx + $(offset of cycles)], %rax
+    emit_u8(e, 0xf0);
+    emit_rex(e, true, REG_ID_RAX, REG_ID_RDX);
+    emit_u8(e, 0x01);
+    emit_modrm_mem(e, REG_ID_RAX, REG_ID_RDX,
+                   offsetof(curry_profile_counters_t, cycles));
+  }
+  emit_mov_reg_reg(e, REG_ID_RAX, REG_ID_R10);
+  emit_mov_reg_reg(e, REG_ID_RDX, REG_ID_R11);
+}
+
+static size_t vcurry_classify(const curry_arg_class_t *classes, size_t nargs,
+                              arg_loc_t *locs) {
+  size_t ngpr = 0;
+  size_t nxmm = 0;
+  size_t nstack = 0;
+  for (size_t i = 0; i < nargs; i++) {
+    if (classes[i] == CURRY_ARG_INTEGER && ngpr < 6)
+      locs[i] = (arg_loc_t){.kind = ARG_LOC_GPR, .index = ngpr++};
+    else if (classes[i] != CURRY_ARG_INTEGER && nxmm < 8)
+      locs[i] = (arg_loc_t){.kind = ARG_LOC_XMM, .index = nxmm++};
+    else
+      locs[i] = (arg_loc_t){.kind = ARG_LOC_STACK, .index = nstack++};
+  }
+  return nstack;
+}
+
+// We only ever use %xmm0 through %xmm7, so none of these need a REX prefix for
+// the XMM register
+
+static void emit_movaps_xmm_xmm(emitter_t *e, size_t dst, size_t src) {
+  assert(dst < 8 && src < 8);
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0x28);
+  emit_u8(e, 0xc0 | dst << 3 | src);
+}
+
+static void emit_xorps_xmm(emitter_t *e, size_t dst) {
+  assert(dst < 8);
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0x57);
+  emit_u8(e, 0xc0 | dst << 3 | dst);
+}
+
+static void emit_movq_xmm_rip(emitter_t *e, size_t dst, int64_t target) {
+  assert(dst < 8);
+  // This form clears the upper half of the register
+  emit_u8(e, 0xf3);
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0x7e);
+  emit_modrm_rip(e, dst, target);
+}
+
+static void emit_movq_mem_xmm(emitter_t *e, reg_id_t base, int32_t disp,
+                              size_t src) {
+  assert(src < 8);
+  // The operand size prefix has to come before any REX prefix
+  emit_u8(e, 0x66);
+  emit_rex(e, false, 0, base);
+  emit_u8(e, 0x0f);
+  emit_u8(e, 0xd6);
+  emit_modrm_mem(e, src, base, disp);
 }
@@ -0,0 +1,66 @@
+#include "curry_cpu.h"
+#include "curry.h"
+
+#include <cpuid.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Feature bits we check. Older versions of <cpuid.h> don't define all of these,
+// so we name them ourselves.
+#define CPUID_1_ECX_OSXSAVE (1u << 27)
+#define CPUID_1_ECX_AVX (1u << 28)
+#define CPUID_7_EDX_IBT (1u << 20)
+// The state components in XCR0 that have to be enabled to use YMM registers
+#define XCR0_SSE (1u << 1)
+#define XCR0_AVX (1u << 2)
+
+// Whether the kernel might have turned on indirect branch tracking for us. It
+// lists the CET features that are on in `/proc/self/status`. Kernels that don't
+// list any can't turn them on at all. If we can't read the file, we can't rule
+// it out.
+static bool cpu_ibt_enabled(void) {
+  FILE *const status = fopen("/proc/self/status", "re");
+  if (status == NULL)
+    return true;
+  bool ret = false;
+  char line[256];
+  while (fgets(line, sizeof(line), status) != NULL) {
+    static const char key[] = "x86_Thread_features:";
+    if (strncmp(line, key, sizeof(key) - 1) != 0)
+      continue;
+    char *save;
+    for (char *feature = strtok_r(line + sizeof(key) - 1, " \t\n", &save);
+         feature != NULL; feature = strtok_r(NULL, " \t\n", &save)) {
+      if (strcmp(feature, "ibt") == 0)
+        ret = true;
+    }
+  }
+  fclose(status);
+  return ret;
+}
+
+// Whether we can use AVX. The CPU has to support it, and the kernel has to save
+// the upper halves of the YMM registers on context switches.
+static bool cpu_avx_usable(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  if ((ecx & CPUID_1_ECX_OSXSAVE) == 0 || (ecx & CPUID_1_ECX_AVX) == 0)
+    return false;
+  uint32_t xcr0_lo, xcr0_hi;
+  __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  return (xcr0_lo & (XCR0_SSE | XCR0_AVX)) == (XCR0_SSE | XCR0_AVX);
+}
+
+void curry_cpu_probe(curry_codegen_info_t *info) {
+  // Without IBT, `endbr64` is a four-byte no-op at the start of every thunk
+  unsigned int eax, ebx, ecx, edx;
+  const bool cpu_ibt = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+                       (edx & CPUID_7_EDX_IBT) != 0;
+  *info = (curry_codegen_info_t){
+      .endbr = cpu_ibt && cpu_ibt_enabled(),
+      .avx_copy = cpu_avx_usable(),
+  };
+}
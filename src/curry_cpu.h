@@ -0,0 +1,17 @@
+/**
+ * \file curry_cpu.h
+ * \brief Working out what code to generate for this machine
+ *
+ * Thunks are generated differently depending on what the CPU supports and what
+ * the kernel has enabled. This checks both. It's only done once, since every
+ * thunk has to be generated the same way for their sizes to be predictable.
+ */
+#pragma once
+
+#include "curry.h"
+
+/**
+ * \brief Check the CPU and the kernel, and decide how to generate code
+ * \param [out] info Where to write the choices
+ */
+void curry_cpu_probe(curry_codegen_info_t *info);
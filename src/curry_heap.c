@@ -0,0 +1,251 @@
+// Needed for `memfd_create`
+#define _GNU_SOURCE
+
+#include "curry_heap.h"
+#include "curry.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Size of an arena in bytes. Every arena costs a file descriptor while it's
+// being set up and two mappings for as long as it lives, so we want these to be
+// fairly large. This is also the size of a huge page, so an arena can be backed
+// by exactly one.
+#define HEAP_ARENA_SIZE (UINT64_C(2) * 1024 * 1024)
+#define HEAP_ARENA_CHUNKS (HEAP_ARENA_SIZE / CURRY_HEAP_CHUNK_SIZE)
+
+// Metadata for an arena. We keep track of which chunks are in use with a
+// bitmap, so it has to have enough bits.
+typedef struct heap_arena_t {
+  struct heap_arena_t *next;
+  uint8_t *rx;
+  uint8_t *rw;
+  uint32_t used;
+  curry_page_mode_t mode;
+} heap_arena_t;
+_Static_assert(HEAP_ARENA_CHUNKS <= 32, "Arena bitmap too small");
+
+// Arenas are only ever added to the front of this list, and they're never
+// removed. So, the list can be walked without holding the lock, as long as the
+// head is published with release semantics.
+static heap_arena_t *heap_arenas = NULL;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+// Number of chunks handed out. It's only written under the lock, but it can be
+// read without it.
+static size_t heap_chunks_in_use = 0;
+// The kind of pages the newest arena got
+static curry_page_mode_t heap_page_mode = CURRY_PAGES_SMALL;
+
+// Whether the kernel will back shared memory with transparent huge pages if we
+// ask it to. If it won't, asking still succeeds, so we have to check.
+static bool heap_thp_available(void) {
+  FILE *const f =
+      fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+  if (f == NULL)
+    return false;
+  // The current setting is the one in brackets
+  char buf[128];
+  const bool ok = fgets(buf, sizeof(buf), f) != NULL &&
+                  strstr(buf, "[never]") == NULL &&
+                  strstr(buf, "[deny]") == NULL;
+  fclose(f);
+  return ok;
+}
+
+// Map a file at an arena-aligned address, by over-allocating and trimming. The
+// executable view has to be aligned so we can find chunks by masking, and huge
+// pages can only be mapped at aligned addresses in both views.
+static uint8_t *heap_map_aligned(int fd, int prot) {
+  uint8_t *const raw = mmap(NULL, 2 * HEAP_ARENA_SIZE, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED)
+    return NULL;
+  uint8_t *const ret = (uint8_t *)(((uintptr_t)raw + HEAP_ARENA_SIZE - 1) &
+                                   ~(uintptr_t)(HEAP_ARENA_SIZE - 1));
+  if (ret != raw)
+    munmap(raw, ret - raw);
+  munmap(ret + HEAP_ARENA_SIZE, raw + HEAP_ARENA_SIZE - ret);
+  if (mmap(ret, HEAP_ARENA_SIZE, prot, MAP_SHARED | MAP_FIXED, fd, 0) ==
+      MAP_FAILED) {
+    munmap(ret, HEAP_ARENA_SIZE);
+    return NULL;
+  }
+  return ret;
+}
+
+// Map the memory for an arena with the given kind of pages. The memory comes
+// from an anonymous file, which we map twice.
+static bool heap_arena_map(heap_arena_t *arena, curry_page_mode_t mode) {
+  if (mode == CURRY_PAGES_TRANSPARENT && !heap_thp_available())
+    return false;
+
+  // Create the backing file. If the kernel seals memfds against execution by
+  // default, we have to ask for execute permissions explicitly. Kernels older
+  // than our headers don't know that flag, and they reject it, but they don't
+  // seal memfds either. So, we try again without it. Reserved huge pages come
+  // from a different filesystem. The default huge page size on x86-64 is the
+  // size of an arena.
+  unsigned int memfd_flags = MFD_CLOEXEC;
+  if (mode == CURRY_PAGES_HUGETLB)
+    memfd_flags |= MFD_HUGETLB;
+#ifdef MFD_EXEC
+  int fd = memfd_create("curry", memfd_flags | MFD_EXEC);
+  if (fd == -1 && errno == EINVAL)
+    fd = memfd_create("curry", memfd_flags);
+#else
+  const int fd = memfd_create("curry", memfd_flags);
+#endif
+  if (fd == -1)
+    return false;
+  if (ftruncate(fd, HEAP_ARENA_SIZE) == -1)
+    goto fail_map;
+
+  // If there aren't enough reserved huge pages, this is where we find out
+  uint8_t *const rx = heap_map_aligned(fd, PROT_READ | PROT_EXEC);
+  if (rx == NULL)
+    goto fail_map;
+  uint8_t *const rw = heap_map_aligned(fd, PROT_READ | PROT_WRITE);
+  if (rw == NULL)
+    goto fail_rx;
+  if (mode == CURRY_PAGES_TRANSPARENT &&
+      (madvise(rx, HEAP_ARENA_SIZE, MADV_HUGEPAGE) == -1 ||
+       madvise(rw, HEAP_ARENA_SIZE, MADV_HUGEPAGE) == -1))
+    goto fail_rw;
+
+  // The mappings keep the file alive
+  close(fd);
+  arena->rx = rx;
+  arena->rw = rw;
+  arena->mode = mode;
+  return true;
+
+fail_rw:
+  munmap(rw, HEAP_ARENA_SIZE);
+fail_rx:
+  munmap(rx, HEAP_ARENA_SIZE);
+fail_map:
+  close(fd);
+  return false;
+}
+
+// Create a new arena. If we can't get the kind of pages that were asked for,
+// fall back to smaller ones.
+static heap_arena_t *heap_arena_create(void) {
+  heap_arena_t *const arena = malloc(sizeof(heap_arena_t));
+  if (arena == NULL)
+    return NULL;
+  curry_page_mode_t mode = curry_get_option(CURRY_OPTION_HUGE_PAGES);
+  while (!heap_arena_map(arena, mode)) {
+    if (mode == CURRY_PAGES_SMALL) {
+      free(arena);
+      return NULL;
+    }
+    mode--;
+  }
+  arena->next = NULL;
+  arena->used = 0;
+  __atomic_store_n(&heap_page_mode, mode, __ATOMIC_RELAXED);
+  return arena;
+}
+
+bool curry_heap_chunk_alloc(uint8_t **rx, uint8_t **rw) {
+  pthread_mutex_lock(&heap_lock);
+
+  // Look for an arena with a free chunk. If there isn't one, make a new arena.
+  heap_arena_t *arena = heap_arenas;
+  while (arena != NULL && arena->used == (UINT64_C(1) << HEAP_ARENA_CHUNKS) - 1)
+    arena = arena->next;
+  if (arena == NULL) {
+    arena = heap_arena_create();
+    if (arena == NULL) {
+      pthread_mutex_unlock(&heap_lock);
+      return false;
+    }
+    arena->next = heap_arenas;
+    __atomic_store_n(&heap_arenas, arena, __ATOMIC_RELEASE);
+  }
+
+  // Take the lowest free chunk
+  const size_t idx = __builtin_ctz(~arena->used);
+  assert(idx < HEAP_ARENA_CHUNKS);
+  arena->used |= UINT32_C(1) << idx;
+  *rx = arena->rx + idx * CURRY_HEAP_CHUNK_SIZE;
+  *rw = arena->rw + idx * CURRY_HEAP_CHUNK_SIZE;
+  __atomic_store_n(&heap_chunks_in_use, heap_chunks_in_use + 1,
+                   __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock(&heap_lock);
+  return true;
+}
+
+void curry_heap_chunk_free(uint8_t *rx) {
+  pthread_mutex_lock(&heap_lock);
+
+  // Find the arena this chunk came from
+  heap_arena_t *arena = heap_arenas;
+  while (arena != NULL &&
+         (rx < arena->rx || rx >= arena->rx + HEAP_ARENA_SIZE))
+    arena = arena->next;
+  assert(arena != NULL && "Chunk not from heap");
+  const size_t idx = (rx - arena->rx) / CURRY_HEAP_CHUNK_SIZE;
+  assert((arena->used & (UINT32_C(1) << idx)) != 0 && "Double free");
+
+  // Punch a hole in the backing file so the memory goes back to the kernel.
+  // This also zeros the chunk for the next user. If it fails, the chunk is
+  // just zeroed by hand. Huge pages can't be given back piecemeal, and trying
+  // would split them, so their chunks are always zeroed by hand.
+  uint8_t *const rw = arena->rw + idx * CURRY_HEAP_CHUNK_SIZE;
+  if (arena->mode != CURRY_PAGES_SMALL ||
+      madvise(rw, CURRY_HEAP_CHUNK_SIZE, MADV_REMOVE) == -1)
+    memset(rw, 0, CURRY_HEAP_CHUNK_SIZE);
+  arena->used &= ~(UINT32_C(1) << idx);
+  __atomic_store_n(&heap_chunks_in_use, heap_chunks_in_use - 1,
+                   __ATOMIC_RELAXED);
+
+  pthread_mutex_unlock(&heap_lock);
+}
+
+bool curry_heap_contains(const void *ptr) {
+  const uint8_t *const p = ptr;
+  for (const heap_arena_t *arena =
+           __atomic_load_n(&heap_arenas, __ATOMIC_ACQUIRE);
+       arena != NULL; arena = arena->next) {
+    if (p >= arena->rx && p < arena->rx + HEAP_ARENA_SIZE)
+      return true;
+  }
+  return false;
+}
+
+size_t curry_heap_bytes_in_use(void) {
+  return __atomic_load_n(&heap_chunks_in_use, __ATOMIC_RELAXED) *
+         CURRY_HEAP_CHUNK_SIZE;
+}
+
+curry_page_mode_t curry_page_mode(void) {
+  return __atomic_load_n(&heap_page_mode, __ATOMIC_RELAXED);
+}
+
+void curry_heap_chunk_prefault(const uint8_t *rx, uint8_t *rw) {
+  // Ask the kernel to fill in the page tables for both views at once. Older
+  // kernels don't know how, so fall back to touching every page ourselves.
+#ifdef MADV_POPULATE_WRITE
+  if (madvise(rw, CURRY_HEAP_CHUNK_SIZE, MADV_POPULATE_WRITE) == 0 &&
+      madvise((void *)rx, CURRY_HEAP_CHUNK_SIZE, MADV_POPULATE_READ) == 0)
+    return;
+#endif
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  for (size_t off = 0; off < CURRY_HEAP_CHUNK_SIZE; off += page_size) {
+    volatile uint8_t *const w = rw + off;
+    *w = *w;
+    (void)*(const volatile uint8_t *)(rx + off);
+  }
+}
@@ -0,0 +1,76 @@
+/**
+ * \file curry_heap.h
+ * \brief Dual-mapped backing store for executable thunk memory
+ *
+ * The heap hands out fixed-size, size-aligned chunks. Each chunk is visible at
+ * two different addresses: an executable view that is never writable, and a
+ * writable view that is never executable. Both are backed by the same memory,
+ * so code written through the writable view can be run from the executable
+ * view immediately, without changing any page permissions.
+ *
+ * Chunks are carved out of much larger arenas, so most allocations don't need
+ * to make any system calls.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Size of a chunk in bytes
+ *
+ * Executable views of chunks are aligned to this size, so the chunk containing
+ * an address can be found by masking.
+ */
+#define CURRY_HEAP_CHUNK_SIZE (UINT64_C(64) * 1024)
+
+/**
+ * \brief Allocate a chunk
+ *
+ * The chunk's contents are zero.
+ *
+ * \param [out] rx Where to write the executable view of the chunk
+ * \param [out] rw Where to write the writable view of the chunk
+ * \return Whether the allocation succeeded
+ */
+bool curry_heap_chunk_alloc(uint8_t **rx, uint8_t **rw);
+
+/**
+ * \brief Return a chunk to the heap
+ *
+ * The memory backing the chunk is released to the operating system, but the
+ * address range stays reserved for later use.
+ *
+ * \param [in] rx The executable view of the chunk
+ */
+void curry_heap_chunk_free(uint8_t *rx);
+
+/**
+ * \brief Fault in all the memory for a chunk, in both views
+ *
+ * Afterwards, reading, writing, or executing the chunk won't cause any page
+ * faults, at least until it's freed.
+ *
+ * \param [in] rx The executable view of the chunk
+ * \param [in] rw The writable view of the chunk
+ */
+void curry_heap_chunk_prefault(const uint8_t *rx, uint8_t *rw);
+
+/**
+ * \brief Check whether an address is in the executable view of the heap
+ *
+ * This doesn't take any locks, so it's cheap enough to call on every free.
+ *
+ * \param [in] ptr The address to check
+ * \return Whether the address is inside some arena
+ */
+bool curry_heap_contains(const void *ptr);
+
+/**
+ * \brief Get the number of bytes in chunks that are currently allocated
+ *
+ * Chunks that aren't allocated aren't backed by any memory, so this is how much
+ * memory the heap is using.
+ */
+size_t curry_heap_bytes_in_use(void);
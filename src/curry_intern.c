@@ -0,0 +1,188 @@
+#include "curry_intern.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// An interned thunk. Entries keep their own copy of the key, so they can be
+// compared without touching the thunk.
+typedef struct intern_entry_t {
+  struct intern_entry_t *next;
+  void *thunk;
+  uint64_t hash;
+  uint64_t refs;
+  const void *fn;
+  size_t nargs_now;
+  size_t nargs_later;
+  uint64_t args[];
+} intern_entry_t;
+
+// Each stripe is an independent chained hash table, with its own lock. The
+// stripe is picked by the low bits of the hash, and the bucket within it by the
+// bits above those. Stripes are kept on separate lines so their locks don't
+// share cache lines.
+#define INTERN_STRIPE_BITS (6)
+#define INTERN_NSTRIPES (1 << INTERN_STRIPE_BITS)
+// The number of buckets a stripe starts with, once it has any entries
+#define INTERN_MIN_BUCKETS (16)
+typedef struct intern_stripe_t {
+  pthread_mutex_t lock;
+  intern_entry_t **buckets;
+  size_t nbuckets;
+  size_t count;
+} __attribute__((aligned(64))) intern_stripe_t;
+
+static intern_stripe_t intern_stripes[INTERN_NSTRIPES] = {
+    [0 ... INTERN_NSTRIPES - 1] = {.lock = PTHREAD_MUTEX_INITIALIZER},
+};
+
+static uint64_t intern_mix(uint64_t x) {
+  x *= UINT64_C(0x9e3779b97f4a7c15);
+  return x ^ (x >> 29);
+}
+
+static uint64_t intern_hash(const curry_intern_key_t *key) {
+  uint64_t h = intern_mix((uintptr_t)key->fn);
+  h = intern_mix(h ^ (key->nargs_now << 16 | key->nargs_later));
+  for (size_t i = 0; i < key->nargs_now; i++)
+    h = intern_mix(h ^ key->args[i]);
+  return h;
+}
+
+static bool intern_matches(const intern_entry_t *entry, uint64_t hash,
+                           const curry_intern_key_t *key) {
+  return entry->hash == hash && entry->fn == key->fn &&
+         entry->nargs_now == key->nargs_now &&
+         entry->nargs_later == key->nargs_later &&
+         memcmp(entry->args, key->args, 8 * key->nargs_now) == 0;
+}
+
+static intern_stripe_t *intern_stripe_of(uint64_t hash) {
+  return &intern_stripes[hash & (INTERN_NSTRIPES - 1)];
+}
+
+// Find the bucket for a hash. The stripe must have buckets.
+static intern_entry_t **intern_bucket_of(intern_stripe_t *stripe,
+                                         uint64_t hash) {
+  assert(stripe->nbuckets != 0);
+  return &stripe->buckets[(hash >> INTERN_STRIPE_BITS) &
+                          (stripe->nbuckets - 1)];
+}
+
+// Double the number of buckets in a stripe. If we can't get the memory, the
+// chains just get longer.
+static void intern_grow(intern_stripe_t *stripe) {
+  const size_t nbuckets =
+      stripe->nbuckets == 0 ? INTERN_MIN_BUCKETS : 2 * stripe->nbuckets;
+  intern_entry_t **const buckets = calloc(nbuckets, sizeof(*buckets));
+  if (buckets == NULL)
+    return;
+  for (size_t i = 0; i < stripe->nbuckets; i++) {
+    intern_entry_t *entry = stripe->buckets[i];
+    while (entry != NULL) {
+      intern_entry_t *const next = entry->next;
+      intern_entry_t **const bucket =
+          &buckets[(entry->hash >> INTERN_STRIPE_BITS) & (nbuckets - 1)];
+      entry->next = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+  free(stripe->buckets);
+  stripe->buckets = buckets;
+  stripe->nbuckets = nbuckets;
+}
+
+void *curry_intern_acquire(const curry_intern_key_t *key) {
+  const uint64_t hash = intern_hash(key);
+  intern_stripe_t *const stripe = intern_stripe_of(hash);
+  void *ret = NULL;
+  pthread_mutex_lock(&stripe->lock);
+  if (stripe->nbuckets != 0) {
+    for (intern_entry_t *entry = *intern_bucket_of(stripe, hash);
+         entry != NULL; entry = entry->next) {
+      if (intern_matches(entry, hash, key)) {
+        entry->refs++;
+        ret = entry->thunk;
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&stripe->lock);
+  return ret;
+}
+
+void *curry_intern_insert(const curry_intern_key_t *key, void *thunk) {
+  const uint64_t hash = intern_hash(key);
+  intern_stripe_t *const stripe = intern_stripe_of(hash);
+
+  // Allocate the entry before taking the lock. We might not need it, but that
+  // should be rare.
+  intern_entry_t *const entry = malloc(sizeof(*entry) + 8 * key->nargs_now);
+  if (entry == NULL)
+    return NULL;
+  entry->thunk = thunk;
+  entry->hash = hash;
+  entry->refs = 1;
+  entry->fn = key->fn;
+  entry->nargs_now = key->nargs_now;
+  entry->nargs_later = key->nargs_later;
+  memcpy(entry->args, key->args, 8 * key->nargs_now);
+
+  pthread_mutex_lock(&stripe->lock);
+  // Check whether someone beat us to it
+  if (stripe->nbuckets != 0) {
+    for (intern_entry_t *other = *intern_bucket_of(stripe, hash);
+         other != NULL; other = other->next) {
+      if (intern_matches(other, hash, key)) {
+        other->refs++;
+        void *const ret = other->thunk;
+        pthread_mutex_unlock(&stripe->lock);
+        free(entry);
+        return ret;
+      }
+    }
+  }
+  if (stripe->count >= stripe->nbuckets)
+    intern_grow(stripe);
+  if (stripe->nbuckets == 0) {
+    pthread_mutex_unlock(&stripe->lock);
+    free(entry);
+    return NULL;
+  }
+  intern_entry_t **const bucket = intern_bucket_of(stripe, hash);
+  entry->next = *bucket;
+  *bucket = entry;
+  stripe->count++;
+  pthread_mutex_unlock(&stripe->lock);
+  return thunk;
+}
+
+bool curry_intern_release(const curry_intern_key_t *key, const void *thunk) {
+  const uint64_t hash = intern_hash(key);
+  intern_stripe_t *const stripe = intern_stripe_of(hash);
+  pthread_mutex_lock(&stripe->lock);
+  assert(stripe->nbuckets != 0 && "Released thunk was never interned");
+  for (intern_entry_t **link = intern_bucket_of(stripe, hash); *link != NULL;
+       link = &(*link)->next) {
+    intern_entry_t *const entry = *link;
+    if (entry->thunk != thunk)
+      continue;
+    const bool last = --entry->refs == 0;
+    if (last) {
+      *link = entry->next;
+      stripe->count--;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    if (last)
+      free(entry);
+    return last;
+  }
+  pthread_mutex_unlock(&stripe->lock);
+  assert(false && "Released thunk was never interned");
+  return true;
+}
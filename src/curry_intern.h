@@ -0,0 +1,63 @@
+/**
+ * \file curry_intern.h
+ * \brief Table of reference-counted thunks, keyed by what they do
+ *
+ * A persistent thunk's behavior is determined entirely by the function it
+ * calls, the arguments it binds, and how many arguments it takes. With
+ * `CURRY_OPTION_INTERN`, thunks that agree on all of those are shared. This
+ * table finds the existing thunk for a key, and counts how many times it has
+ * been handed out so it's only freed when the last user lets go of it.
+ *
+ * The table is split into stripes, each with its own lock, so threads
+ * interning different thunks rarely contend.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief What a thunk is interned by
+ *
+ * The arguments aren't copied until the thunk is inserted, so they only have
+ * to live as long as the call.
+ */
+typedef struct curry_intern_key_t {
+  const void *fn;
+  const uint64_t *args;
+  size_t nargs_now;
+  size_t nargs_later;
+} curry_intern_key_t;
+
+/**
+ * \brief Find the thunk for a key, and take a reference to it
+ * \param [in] key The key to look for
+ * \return The thunk, or `NULL` if there isn't one
+ */
+void *curry_intern_acquire(const curry_intern_key_t *key);
+
+/**
+ * \brief Add a newly created thunk to the table, with one reference
+ *
+ * Another thread might have inserted a thunk for the same key since we last
+ * looked. If so, that thunk wins. A reference to it is taken and it's returned
+ * instead, and the caller should free its own thunk.
+ *
+ * \param [in] key The key for the thunk
+ * \param [in] thunk The thunk to insert
+ * \return The thunk that's now in the table, or `NULL` if memory for the entry
+ * couldn't be allocated
+ */
+void *curry_intern_insert(const curry_intern_key_t *key, void *thunk);
+
+/**
+ * \brief Drop a reference to an interned thunk
+ *
+ * If this was the last reference, the thunk is removed from the table.
+ *
+ * \param [in] key The key the thunk was inserted with
+ * \param [in] thunk The thunk to release
+ * \return Whether that was the last reference, so the thunk should be freed
+ */
+bool curry_intern_release(const curry_intern_key_t *key, const void *thunk);
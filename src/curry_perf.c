@@ -0,0 +1,121 @@
+// Needed for `dladdr`
+#define _GNU_SOURCE
+
+#include "curry_perf.h"
+#include "curry.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Entries are appended here, and written out once it fills up, when asked to,
+// or when the process exits. The file is opened the first time we write to it.
+// All of this is protected by the lock.
+#define PERF_BUFFER_SIZE (64 * 1024)
+// The longest entry we'll write. Longer symbol names are cut short.
+#define PERF_ENTRY_MAX (512)
+static char perf_buffer[PERF_BUFFER_SIZE];
+static size_t perf_buffer_used = 0;
+static int perf_fd = -1;
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t perf_once = PTHREAD_ONCE_INIT;
+
+// Write out everything in the buffer. Entries are dropped if the file can't be
+// written, since there's nobody to report the error to.
+static void perf_flush_locked(void) {
+  if (perf_buffer_used == 0)
+    return;
+  if (perf_fd == -1) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+    perf_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                   S_IRUSR | S_IWUSR);
+  }
+  for (size_t off = 0; perf_fd != -1 && off < perf_buffer_used;) {
+    const ssize_t written =
+        write(perf_fd, perf_buffer + off, perf_buffer_used - off);
+    if (written <= 0)
+      break;
+    off += written;
+  }
+  perf_buffer_used = 0;
+}
+
+// A forked child has a different pid, so it needs its own file. It has all of
+// its parent's thunks, but only the entries that were still in the buffer make
+// it into its file.
+static void perf_fork_child(void) {
+  if (perf_fd != -1)
+    close(perf_fd);
+  perf_fd = -1;
+  pthread_mutex_init(&perf_lock, NULL);
+}
+
+static void perf_init(void) {
+  atexit(curry_perf_map_flush);
+  pthread_atfork(NULL, NULL, perf_fork_child);
+}
+
+// Add one entry to the buffer, making room for it first if needed
+static void perf_append(const char *entry, size_t len) {
+  pthread_once(&perf_once, perf_init);
+  pthread_mutex_lock(&perf_lock);
+  if (perf_buffer_used + len > PERF_BUFFER_SIZE)
+    perf_flush_locked();
+  memcpy(perf_buffer + perf_buffer_used, entry, len);
+  perf_buffer_used += len;
+  pthread_mutex_unlock(&perf_lock);
+}
+
+// Each entry is the start address and size in hex, then the symbol name. We
+// snprintf into a local buffer so the lock isn't held while formatting.
+static void perf_entry(const void *code, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+static void perf_entry(const void *code, size_t size, const char *fmt, ...) {
+  char entry[PERF_ENTRY_MAX];
+  int len = snprintf(entry, sizeof(entry), "%lx %zx ", (unsigned long)code,
+                     size);
+  va_list args;
+  va_start(args, fmt);
+  len += vsnprintf(entry + len, sizeof(entry) - len, fmt, args);
+  va_end(args);
+  // Make sure the entry ends with a newline, even if it was cut short
+  if ((size_t)len >= sizeof(entry) - 1)
+    len = sizeof(entry) - 2;
+  entry[len++] = '\n';
+  perf_append(entry, len);
+}
+
+void curry_perf_thunk(const void *thunk, size_t size, const void *fn,
+                      size_t nargs_now, size_t nargs_later) {
+  // Name the thunk after the function it calls, if it has a dynamic symbol.
+  // Otherwise, all we have is its address.
+  Dl_info info;
+  if (dladdr(fn, &info) != 0 && info.dli_sname != NULL &&
+      info.dli_saddr == fn) {
+    perf_entry(thunk, size, "curry_thunk<%s,now=%zu,later=%zu>",
+               info.dli_sname, nargs_now, nargs_later);
+  } else {
+    perf_entry(thunk, size, "curry_thunk<%p,now=%zu,later=%zu>", fn,
+               nargs_now, nargs_later);
+  }
+}
+
+void curry_perf_shape(const void *code, size_t size, size_t nargs_now,
+                      size_t nargs_later, bool persistent) {
+  perf_entry(code, size, "curry_shape<now=%zu,later=%zu%s>", nargs_now,
+             nargs_later, persistent ? ",persistent" : "");
+}
+
+void curry_perf_map_flush(void) {
+  pthread_mutex_lock(&perf_lock);
+  perf_flush_locked();
+  pthread_mutex_unlock(&perf_lock);
+}
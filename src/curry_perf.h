@@ -0,0 +1,35 @@
+/**
+ * \file curry_perf.h
+ * \brief Symbols for thunks, so profilers can name them
+ *
+ * With `CURRY_OPTION_PERF_MAP`, every thunk and every piece of shared code is
+ * listed in `/tmp/perf-<pid>.map`, which `perf` reads to symbolize JIT code.
+ * Entries are collected in a buffer and written out in batches, so creating
+ * thunks doesn't make a system call each time.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * \brief List a thunk in the perf map
+ * \param [in] thunk The thunk's code
+ * \param [in] size The size of the thunk's code
+ * \param [in] fn The function the thunk calls
+ * \param [in] nargs_now The number of arguments the thunk binds
+ * \param [in] nargs_later The number of arguments the thunk takes
+ */
+void curry_perf_thunk(const void *thunk, size_t size, const void *fn,
+                      size_t nargs_now, size_t nargs_later);
+
+/**
+ * \brief List the code shared by thunks of a shape in the perf map
+ * \param [in] code The shared code
+ * \param [in] size The size of the code
+ * \param [in] nargs_now The number of arguments the thunks bind
+ * \param [in] nargs_later The number of arguments the thunks take
+ * \param [in] persistent Whether the thunks are persistent
+ */
+void curry_perf_shape(const void *code, size_t size, size_t nargs_now,
+                      size_t nargs_later, bool persistent);
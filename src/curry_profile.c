@@ -0,0 +1,92 @@
+#include "curry_profile.h"
+#include "curry.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Counters for one key. Entries are on their own cache lines, so threads
+// calling different thunks don't fight over them. Every entry is on a chain in
+// the table, and on a list of all of them in the order they were created.
+typedef struct profile_entry_t {
+  curry_profile_counters_t counters;
+  struct profile_entry_t *chain;
+  struct profile_entry_t *next;
+  const void *fn;
+  size_t nargs_now;
+  size_t nargs_later;
+} __attribute__((aligned(64))) profile_entry_t;
+
+// Entries are only looked up when thunks are created, so a single lock and a
+// fixed number of buckets is plenty
+#define PROFILE_NBUCKETS (256)
+static profile_entry_t *profile_buckets[PROFILE_NBUCKETS];
+static profile_entry_t *profile_entries = NULL;
+static profile_entry_t **profile_entries_tail = &profile_entries;
+static size_t profile_count = 0;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t profile_bucket_of(const void *fn, size_t nargs_now,
+                                size_t nargs_later) {
+  uint64_t h = (uintptr_t)fn ^ (nargs_now << 48) ^ (nargs_later << 32);
+  h *= UINT64_C(0x9e3779b97f4a7c15);
+  return h >> 56;
+}
+
+curry_profile_counters_t *curry_profile_counters(const void *fn,
+                                                 size_t nargs_now,
+                                                 size_t nargs_later) {
+  profile_entry_t **const bucket =
+      &profile_buckets[profile_bucket_of(fn, nargs_now, nargs_later)];
+  pthread_mutex_lock(&profile_lock);
+  profile_entry_t *entry = *bucket;
+  while (entry != NULL && (entry->fn != fn || entry->nargs_now != nargs_now ||
+                           entry->nargs_later != nargs_later))
+    entry = entry->chain;
+  if (entry == NULL) {
+    entry = aligned_alloc(_Alignof(profile_entry_t), sizeof(*entry));
+    if (entry != NULL) {
+      *entry = (profile_entry_t){
+          .chain = *bucket,
+          .fn = fn,
+          .nargs_now = nargs_now,
+          .nargs_later = nargs_later,
+      };
+      *bucket = entry;
+      *profile_entries_tail = entry;
+      profile_entries_tail = &entry->next;
+      profile_count++;
+    }
+  }
+  pthread_mutex_unlock(&profile_lock);
+  return entry != NULL ? &entry->counters : NULL;
+}
+
+size_t curry_profile_dump(curry_profile_t *entries, size_t max) {
+  pthread_mutex_lock(&profile_lock);
+  size_t i = 0;
+  for (const profile_entry_t *entry = profile_entries;
+       entry != NULL && i < max; entry = entry->next, i++) {
+    entries[i] = (curry_profile_t){
+        .fn = (void *)entry->fn,
+        .nargs_now = entry->nargs_now,
+        .nargs_later = entry->nargs_later,
+        .calls = __atomic_load_n(&entry->counters.calls, __ATOMIC_RELAXED),
+        .cycles = __atomic_load_n(&entry->counters.cycles, __ATOMIC_RELAXED),
+    };
+  }
+  const size_t ret = profile_count;
+  pthread_mutex_unlock(&profile_lock);
+  return ret;
+}
+
+void curry_profile_reset(void) {
+  pthread_mutex_lock(&profile_lock);
+  for (profile_entry_t *entry = profile_entries; entry != NULL;
+       entry = entry->next) {
+    __atomic_store_n(&entry->counters.calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->counters.cycles, 0, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&profile_lock);
+}
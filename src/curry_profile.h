@@ -0,0 +1,35 @@
+/**
+ * \file curry_profile.h
+ * \brief Counters updated by profiled thunks
+ *
+ * With `CURRY_OPTION_PROFILE`, each thunk's code has the address of its
+ * counters built in, and updates them with atomic instructions. Thunks with the
+ * same function and shape share counters. Counters are never freed, since a
+ * thunk could be using them at any time, so there's one for every key that was
+ * ever profiled.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief What profiled thunks update
+ *
+ * Thunks rely on this layout, since they address the fields directly.
+ */
+typedef struct curry_profile_counters_t {
+  uint64_t calls;
+  uint64_t cycles;
+} curry_profile_counters_t;
+
+/**
+ * \brief Find the counters for a function and shape, creating them if needed
+ * \param [in] fn The function the thunks call
+ * \param [in] nargs_now The number of arguments the thunks bind
+ * \param [in] nargs_later The number of arguments the thunks take
+ * \return The counters, or `NULL` if memory for them couldn't be allocated
+ */
+curry_profile_counters_t *curry_profile_counters(const void *fn,
+                                                 size_t nargs_now,
+                                                 size_t nargs_later);
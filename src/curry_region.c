@@ -0,0 +1,141 @@
+#include "curry_region.h"
+#include "curry.h"
+#include "curry_heap.h"
+#include "curry_stats.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Thunks are aligned to this many bytes. That's enough for the records at their
+// ends, and it's how functions are usually aligned.
+#define REGION_ALIGN (UINT64_C(16))
+// The first line of each chunk stays zero, since that's where the slab
+// allocator keeps its header
+#define REGION_HEADER_SIZE (UINT64_C(64))
+
+// A chunk owned by a region. Like the slab allocator's metadata, this lives in
+// `malloc`ed memory, so it can't be hit by a stray write through the chunk.
+typedef struct region_chunk_t {
+  struct region_chunk_t *next;
+  uint8_t *rx;
+  uint8_t *rw;
+} region_chunk_t;
+
+struct curry_region_t {
+  // Every chunk in the region, with the one being allocated from first
+  region_chunk_t *chunks;
+  // How much of the first chunk is used
+  size_t used;
+  // What's been allocated, so it can be counted as freed all at once
+  size_t nthunks;
+  size_t bytes;
+};
+
+// Chunks emptied by destroyed regions. They aren't zeroed, since stale thunks
+// are never looked at, only overwritten. We only keep a few, so a burst of
+// large regions doesn't hold on to memory forever.
+#define REGION_KEEP (16)
+static region_chunk_t *region_spare;
+static size_t region_nspare;
+static pthread_mutex_t region_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Get a chunk, preferring one that's been used before
+static region_chunk_t *region_chunk_get(void) {
+  pthread_mutex_lock(&region_lock);
+  region_chunk_t *chunk = region_spare;
+  if (chunk != NULL) {
+    region_spare = chunk->next;
+    region_nspare--;
+  }
+  pthread_mutex_unlock(&region_lock);
+  if (chunk != NULL)
+    return chunk;
+
+  chunk = malloc(sizeof(region_chunk_t));
+  if (chunk == NULL)
+    return NULL;
+  if (!curry_heap_chunk_alloc(&chunk->rx, &chunk->rw)) {
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
+}
+
+// Give a list of chunks back, keeping some of them for later. This shouldn't
+// be called with the lock held.
+static void region_chunks_put(region_chunk_t *list) {
+  pthread_mutex_lock(&region_lock);
+  while (list != NULL && region_nspare < REGION_KEEP) {
+    region_chunk_t *const next = list->next;
+    list->next = region_spare;
+    region_spare = list;
+    region_nspare++;
+    list = next;
+  }
+  pthread_mutex_unlock(&region_lock);
+  while (list != NULL) {
+    region_chunk_t *const next = list->next;
+    curry_heap_chunk_free(list->rx);
+    free(list);
+    list = next;
+  }
+}
+
+curry_region_t *curry_region_create(void) {
+  // The first chunk is only taken when the first thunk is made, so an unused
+  // region doesn't cost anything
+  return calloc(1, sizeof(curry_region_t));
+}
+
+void curry_region_destroy(curry_region_t *region) {
+  if (region == NULL)
+    return;
+  if (region->nthunks != 0)
+    curry_stats_freed_many(region->bytes, region->nthunks);
+  region_chunks_put(region->chunks);
+  free(region);
+}
+
+size_t curry_region_size_for(size_t size) {
+  const size_t ret = (size + REGION_ALIGN - 1) & ~(REGION_ALIGN - 1);
+  return ret <= CURRY_HEAP_CHUNK_SIZE - REGION_HEADER_SIZE ? ret : 0;
+}
+
+uint8_t *curry_region_alloc(curry_region_t *region, size_t size,
+                            uint8_t **rw) {
+  assert(size % REGION_ALIGN == 0 && "Size not from curry_region_size_for");
+  assert(size <= CURRY_HEAP_CHUNK_SIZE - REGION_HEADER_SIZE);
+  // Start a new chunk if this doesn't fit in the current one. Whatever's left
+  // at the end of the old one is wasted.
+  if (region->chunks == NULL || region->used + size > CURRY_HEAP_CHUNK_SIZE) {
+    region_chunk_t *const chunk = region_chunk_get();
+    if (chunk == NULL)
+      return NULL;
+    chunk->next = region->chunks;
+    region->chunks = chunk;
+    region->used = REGION_HEADER_SIZE;
+  }
+  uint8_t *const ret = region->chunks->rx + region->used;
+  *rw = region->chunks->rw + region->used;
+  region->used += size;
+  region->nthunks++;
+  region->bytes += size;
+  return ret;
+}
+
+void curry_region_trim(void) {
+  pthread_mutex_lock(&region_lock);
+  region_chunk_t *list = region_spare;
+  region_spare = NULL;
+  region_nspare = 0;
+  pthread_mutex_unlock(&region_lock);
+  while (list != NULL) {
+    region_chunk_t *const next = list->next;
+    curry_heap_chunk_free(list->rx);
+    free(list);
+    list = next;
+  }
+}
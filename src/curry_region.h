@@ -0,0 +1,45 @@
+/**
+ * \file curry_region.h
+ * \brief Bump allocation for thunks that are all freed together
+ *
+ * A region hands out space for thunks by bumping a pointer through chunks it
+ * owns, and it frees all of them at once when it's destroyed. The chunks come
+ * straight from the heap, but they're never touched by the slab allocator. The
+ * first line of each one is left zero, so `curry_slab_slot_size` doesn't
+ * mistake region thunks for slots.
+ *
+ * Emptied chunks are kept around for the next region, so a region that's
+ * created and destroyed over and over doesn't have to map memory or take page
+ * faults.
+ */
+#pragma once
+
+#include "curry.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Get the space a region would use for an allocation
+ * \param [in] size The minimum number of bytes needed
+ * \return The number of bytes to ask `curry_region_alloc` for, or zero if the
+ * allocation is too large
+ */
+size_t curry_region_size_for(size_t size);
+
+/**
+ * \brief Allocate space for a thunk in a region
+ *
+ * The space is only freed when the region is destroyed.
+ *
+ * \param [in] region The region to allocate from
+ * \param [in] size The number of bytes, from `curry_region_size_for`
+ * \param [out] rw Where to write the writable view of the space
+ * \return The executable view of the space, or `NULL` on failure
+ */
+uint8_t *curry_region_alloc(curry_region_t *region, size_t size, uint8_t **rw);
+
+/**
+ * \brief Give the chunks kept for future regions back to the heap
+ */
+void curry_region_trim(void);
@@ -0,0 +1,684 @@
+#include "curry_slab.h"
+#include "curry.h"
+#include "curry_heap.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Chunks come from the heap, which aligns them to their size. That way, we can
+// find the chunk a slot belongs to just by masking off the low bits of its
+// address.
+#define SLAB_CHUNK_SIZE CURRY_HEAP_CHUNK_SIZE
+// Slots are aligned to this many bytes
+#define SLAB_LINE_SIZE (UINT64_C(64))
+
+// The sizes of slots that we hand out. All of these are multiples of the line
+// size, and the largest has to be at least as large as the biggest thunk that
+// `vcurry` can ask for.
+static const size_t slab_class_sizes[] = {
+    64,   128,  192,  256,  384,  512,  768,
+    1024, 1536, 2048, 3072, 4096, 6144, 8192,
+};
+#define SLAB_NCLASSES (sizeof(slab_class_sizes) / sizeof(slab_class_sizes[0]))
+
+// Metadata for a chunk. This lives in `malloc`ed memory, not in the chunk
+// itself, so that a stray write through a chunk's writable view can't corrupt
+// it. The first line of the chunk holds a pointer back to this structure. The
+// free list is a linked list of slot indices.
+typedef struct slab_chunk_t {
+  struct slab_chunk_t *prev;
+  struct slab_chunk_t *next;
+  uint8_t *base;
+  uint8_t *rw;
+  size_t class_idx;
+  size_t nslots;
+  size_t nfree;
+  size_t free_head;
+  size_t free_next[];
+} slab_chunk_t;
+
+// Each size class keeps a list of chunks that have at least one free slot, and
+// a list of completely empty ones. We hold on to one empty chunk per class, so
+// that we don't thrash when a single thunk is repeatedly created and freed.
+// `curry_slab_reserve` can raise that to make room for more thunks ahead of
+// time.
+//
+// The rest are surplus, and they go back to the heap. That's a system call, and
+// the last free of a chunk is often a one-shot thunk on its way back to its
+// caller. So, frees only count surplus chunks, and they're reclaimed in
+// batches by the next allocation that has to take the lock anyway, or by
+// `curry_slab_trim`. Until then, they can still be reused.
+typedef struct slab_class_t {
+  slab_chunk_t *partial;
+  slab_chunk_t *empty;
+  size_t nempty;
+  size_t keep;
+} slab_class_t;
+
+static slab_class_t slab_classes[SLAB_NCLASSES] = {
+    [0 ... SLAB_NCLASSES - 1] = {.keep = 1},
+};
+// The number of surplus empty chunks across all classes
+static size_t slab_nsurplus = 0;
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Taking the lock on every allocation and free doesn't scale, so each thread
+// caches free slots in magazines, one per class. A magazine is just a stack of
+// slots. When a thread's magazine runs dry or fills up, it trades it with the
+// depot, which is a lock-free stack of full magazines shared by all threads.
+// Only if the depot can't help do we take the lock.
+//
+// Magazines are never freed. Empty ones go on their own stack for reuse.
+#define SLAB_MAG_CAPACITY (32)
+// The depot holds at most this many full magazines per class. Past that, we
+// return the slots to their chunks so the memory can be reclaimed.
+#define SLAB_DEPOT_MAX (16)
+
+typedef struct slab_mag_t {
+  struct slab_mag_t *next;
+  size_t count;
+  void *slots[SLAB_MAG_CAPACITY];
+} slab_mag_t;
+
+// A lock-free stack of magazines. To avoid the ABA problem, the top pointer is
+// paired with a counter that's bumped on every change, and both are swapped at
+// once with a double-width compare-and-swap.
+typedef union slab_stack_t {
+  struct {
+    slab_mag_t *top;
+    uint64_t tag;
+  };
+  unsigned __int128 raw;
+} __attribute__((aligned(16))) slab_stack_t;
+
+typedef struct slab_depot_t {
+  slab_stack_t full;
+  size_t nfull;
+} slab_depot_t;
+
+static slab_depot_t slab_depots[SLAB_NCLASSES];
+static slab_stack_t slab_mags_empty;
+
+// Each thread's cache. We keep track of how many bytes of slots it holds so
+// that it can be bounded by `CURRY_OPTION_THREAD_CACHE`.
+typedef struct slab_tcache_t {
+  slab_mag_t *mags[SLAB_NCLASSES];
+  size_t bytes;
+  bool registered;
+} slab_tcache_t;
+
+static __thread slab_tcache_t slab_tcache;
+// Used to flush a thread's cache when it exits
+static pthread_key_t slab_tcache_key;
+static pthread_once_t slab_tcache_key_once = PTHREAD_ONCE_INIT;
+
+// The first line of every chunk holds a pointer to its metadata, followed by
+// the constants
+_Static_assert(sizeof(slab_chunk_t *) + sizeof(curry_slab_constants) <=
+                   SLAB_LINE_SIZE,
+               "Chunk header too large");
+
+// Find the chunk metadata for a slot
+static slab_chunk_t *slab_chunk_of(const void *slot) {
+  const uintptr_t base = (uintptr_t)slot & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1);
+  return *(slab_chunk_t *const *)base;
+}
+
+// Linked list management for the partial and empty lists
+static void slab_list_push(slab_chunk_t **head, slab_chunk_t *chunk) {
+  chunk->prev = NULL;
+  chunk->next = *head;
+  if (*head != NULL)
+    (*head)->prev = chunk;
+  *head = chunk;
+}
+static void slab_list_remove(slab_chunk_t **head, slab_chunk_t *chunk) {
+  if (chunk->prev != NULL)
+    chunk->prev->next = chunk->next;
+  else
+    *head = chunk->next;
+  if (chunk->next != NULL)
+    chunk->next->prev = chunk->prev;
+  chunk->prev = NULL;
+  chunk->next = NULL;
+}
+
+// The number of slots in each chunk of a class. The first line holds the
+// chunk's header.
+static size_t slab_class_nslots(size_t class_idx) {
+  return (SLAB_CHUNK_SIZE - SLAB_LINE_SIZE) / slab_class_sizes[class_idx];
+}
+
+// Create a new chunk for the given class. The chunk starts out with all its
+// slots free. It's not on any list.
+static slab_chunk_t *slab_chunk_create(size_t class_idx) {
+  const size_t nslots = slab_class_nslots(class_idx);
+  assert(nslots > 0 && "Slot too large for chunk");
+
+  slab_chunk_t *const chunk =
+      malloc(sizeof(slab_chunk_t) + nslots * sizeof(size_t));
+  if (chunk == NULL)
+    return NULL;
+
+  uint8_t *base;
+  uint8_t *rw;
+  if (!curry_heap_chunk_alloc(&base, &rw)) {
+    free(chunk);
+    return NULL;
+  }
+  *(slab_chunk_t **)rw = chunk;
+  memcpy(rw + sizeof(slab_chunk_t *), curry_slab_constants,
+         sizeof(curry_slab_constants));
+
+  chunk->prev = NULL;
+  chunk->next = NULL;
+  chunk->base = base;
+  chunk->rw = rw;
+  chunk->class_idx = class_idx;
+  chunk->nslots = nslots;
+  chunk->nfree = nslots;
+  chunk->free_head = 0;
+  for (size_t i = 0; i < nslots; i++)
+    chunk->free_next[i] = i + 1;
+  return chunk;
+}
+
+// Destroy a list of chunks chained through `next`. This shouldn't be called
+// with the lock held.
+static void slab_chunks_destroy(slab_chunk_t *list) {
+  while (list != NULL) {
+    slab_chunk_t *const next = list->next;
+    curry_heap_chunk_free(list->base);
+    free(list);
+    list = next;
+  }
+}
+
+// Take all the surplus empty chunks off their lists, and chain them together
+// through `next`. The caller must hold the lock, and it should destroy the
+// chunks once it has released it.
+static slab_chunk_t *slab_reclaim_locked(void) {
+  slab_chunk_t *ret = NULL;
+  for (size_t c = 0; c < SLAB_NCLASSES && slab_nsurplus != 0; c++) {
+    slab_class_t *const cls = &slab_classes[c];
+    // Keep the chunk at the head, since it was emptied most recently
+    assert(cls->keep > 0);
+    while (cls->nempty > cls->keep) {
+      slab_chunk_t *const chunk = cls->empty->next;
+      slab_list_remove(&cls->empty, chunk);
+      cls->nempty--;
+      slab_nsurplus--;
+      chunk->next = ret;
+      ret = chunk;
+    }
+  }
+  assert(slab_nsurplus == 0);
+  return ret;
+}
+
+// Find the smallest class that fits the given size, or `SLAB_NCLASSES` if none
+// of them do
+static size_t slab_class_for(size_t size) {
+  size_t class_idx = 0;
+  while (class_idx < SLAB_NCLASSES && slab_class_sizes[class_idx] < size)
+    class_idx++;
+  return class_idx;
+}
+
+// Allocate a slot from a class. The caller must hold the lock.
+static uint8_t *slab_alloc_locked(size_t class_idx) {
+  slab_class_t *const cls = &slab_classes[class_idx];
+
+  // Find a chunk with a free slot. Prefer partially used chunks, then empty
+  // ones, and only then go to the heap.
+  slab_chunk_t *chunk = cls->partial;
+  if (chunk == NULL) {
+    chunk = cls->empty;
+    if (chunk != NULL) {
+      slab_list_remove(&cls->empty, chunk);
+      if (cls->nempty-- > cls->keep)
+        slab_nsurplus--;
+    } else {
+      chunk = slab_chunk_create(class_idx);
+      if (chunk == NULL)
+        return NULL;
+    }
+    slab_list_push(&cls->partial, chunk);
+  }
+
+  // Pop a slot off its free list. If that was the last one, the chunk is no
+  // longer partial.
+  assert(chunk->nfree > 0 && chunk->free_head < chunk->nslots);
+  const size_t idx = chunk->free_head;
+  chunk->free_head = chunk->free_next[idx];
+  chunk->nfree--;
+  if (chunk->nfree == 0)
+    slab_list_remove(&cls->partial, chunk);
+
+  return chunk->base + SLAB_LINE_SIZE + idx * slab_class_sizes[class_idx];
+}
+
+// Defined below, with the rest of the thread cache
+static uint8_t *slab_tcache_alloc(size_t class_idx);
+static uint8_t *slab_tcache_take(size_t class_idx);
+
+uint8_t *curry_slab_alloc(size_t size) {
+  const size_t class_idx = slab_class_for(size);
+  if (class_idx == SLAB_NCLASSES)
+    return NULL;
+  // Try the fast path first
+  uint8_t *const cached = slab_tcache_alloc(class_idx);
+  if (cached != NULL)
+    return cached;
+  pthread_mutex_lock(&slab_lock);
+  uint8_t *const ret = slab_alloc_locked(class_idx);
+  slab_chunk_t *const reclaimed = slab_reclaim_locked();
+  pthread_mutex_unlock(&slab_lock);
+  slab_chunks_destroy(reclaimed);
+  return ret;
+}
+
+bool curry_slab_alloc_many(size_t size, size_t count, void **out) {
+  const size_t class_idx = slab_class_for(size);
+  if (class_idx == SLAB_NCLASSES)
+    return false;
+
+  // A single allocation is common, and it's best served by the thread cache.
+  // For larger batches, use whatever the cache has on hand.
+  size_t i = 0;
+  if (count == 1) {
+    out[0] = slab_tcache_alloc(class_idx);
+    if (out[0] != NULL)
+      return true;
+  } else {
+    for (; i < count; i++) {
+      out[i] = slab_tcache_take(class_idx);
+      if (out[i] == NULL)
+        break;
+    }
+  }
+
+  // Take the lock once for the rest of the batch. Consecutive slots from the
+  // same chunk are adjacent, so the batch ends up mostly contiguous.
+  pthread_mutex_lock(&slab_lock);
+  for (; i < count; i++) {
+    out[i] = slab_alloc_locked(class_idx);
+    if (out[i] == NULL)
+      break;
+  }
+  slab_chunk_t *const reclaimed = slab_reclaim_locked();
+  pthread_mutex_unlock(&slab_lock);
+  slab_chunks_destroy(reclaimed);
+
+  // If we ran out of memory partway through, give back what we got
+  if (i != count) {
+    for (size_t j = 0; j < i; j++)
+      curry_slab_free(out[j]);
+    return false;
+  }
+  return true;
+}
+
+// Return a slot to its chunk. The caller must hold the lock.
+static void slab_free_locked(void *slot) {
+  slab_chunk_t *const chunk = slab_chunk_of(slot);
+  slab_class_t *const cls = &slab_classes[chunk->class_idx];
+  const size_t offset = (uint8_t *)slot - chunk->base - SLAB_LINE_SIZE;
+  const size_t idx = offset / slab_class_sizes[chunk->class_idx];
+  assert(offset % slab_class_sizes[chunk->class_idx] == 0 && "Bad slot");
+  assert(idx < chunk->nslots && "Bad slot");
+
+  // Push the slot onto the free list. If the chunk was full, it's partial now.
+  chunk->free_next[idx] = chunk->free_head;
+  chunk->free_head = idx;
+  chunk->nfree++;
+  if (chunk->nfree == 1)
+    slab_list_push(&cls->partial, chunk);
+
+  // If the chunk is completely free, it's empty now
+  if (chunk->nfree == chunk->nslots) {
+    slab_list_remove(&cls->partial, chunk);
+    slab_list_push(&cls->empty, chunk);
+    if (++cls->nempty > cls->keep)
+      slab_nsurplus++;
+  }
+}
+
+// Return all the slots in a magazine to their chunks, leaving it empty. Like
+// any other free, this leaves emptied chunks for an allocation to reclaim.
+static void slab_mag_drain(slab_mag_t *mag) {
+  pthread_mutex_lock(&slab_lock);
+  for (size_t i = 0; i < mag->count; i++)
+    slab_free_locked(mag->slots[i]);
+  pthread_mutex_unlock(&slab_lock);
+  mag->count = 0;
+}
+
+// Read both halves of the stack at once. A swap of zero for zero does that,
+// since it only writes if the stack is already all zeros. Unlike a 16-byte
+// atomic load, it doesn't need libatomic.
+static slab_stack_t slab_stack_load(slab_stack_t *stack) {
+  slab_stack_t ret;
+  ret.raw = __sync_val_compare_and_swap(&stack->raw, 0, 0);
+  return ret;
+}
+
+static void slab_stack_push(slab_stack_t *stack, slab_mag_t *mag) {
+  slab_stack_t old = slab_stack_load(stack), new, seen;
+  for (;;) {
+    __atomic_store_n(&mag->next, old.top, __ATOMIC_RELAXED);
+    new.top = mag;
+    new.tag = old.tag + 1;
+    // On failure, the swap gives back the stack as it is now, so retry with
+    // that
+    seen.raw = __sync_val_compare_and_swap(&stack->raw, old.raw, new.raw);
+    if (seen.raw == old.raw)
+      return;
+    old = seen;
+  }
+}
+
+static slab_mag_t *slab_stack_pop(slab_stack_t *stack) {
+  slab_stack_t old = slab_stack_load(stack), new, seen;
+  for (;;) {
+    if (old.top == NULL)
+      return NULL;
+    // Magazines are never freed, so this is safe to read even if someone else
+    // pops it first. In that case, the tag will have changed, and the swap
+    // will fail.
+    new.top = __atomic_load_n(&old.top->next, __ATOMIC_RELAXED);
+    new.tag = old.tag + 1;
+    seen.raw = __sync_val_compare_and_swap(&stack->raw, old.raw, new.raw);
+    if (seen.raw == old.raw)
+      return old.top;
+    old = seen;
+  }
+}
+
+// Get an empty magazine, or `NULL` if we're out of memory
+static slab_mag_t *slab_mag_get_empty(void) {
+  slab_mag_t *ret = slab_stack_pop(&slab_mags_empty);
+  if (ret == NULL)
+    ret = malloc(sizeof(slab_mag_t));
+  if (ret != NULL)
+    ret->count = 0;
+  return ret;
+}
+
+// Hand a full magazine to the depot. If the depot already has enough, give the
+// slots back to their chunks instead.
+static void slab_depot_put(size_t class_idx, slab_mag_t *mag) {
+  slab_depot_t *const depot = &slab_depots[class_idx];
+  const size_t nfull = __atomic_fetch_add(&depot->nfull, 1, __ATOMIC_RELAXED);
+  if (nfull >= SLAB_DEPOT_MAX) {
+    __atomic_fetch_sub(&depot->nfull, 1, __ATOMIC_RELAXED);
+    slab_mag_drain(mag);
+    slab_stack_push(&slab_mags_empty, mag);
+    return;
+  }
+  slab_stack_push(&depot->full, mag);
+}
+
+// Take a full magazine from the depot, or return `NULL` if there aren't any
+static slab_mag_t *slab_depot_take(size_t class_idx) {
+  slab_depot_t *const depot = &slab_depots[class_idx];
+  slab_mag_t *const ret = slab_stack_pop(&depot->full);
+  if (ret != NULL)
+    __atomic_fetch_sub(&depot->nfull, 1, __ATOMIC_RELAXED);
+  return ret;
+}
+
+// Called when a thread exits. Its full magazines go to the depot, so other
+// threads can use the slots.
+static void slab_tcache_flush(void *arg) {
+  slab_tcache_t *const tcache = arg;
+  for (size_t c = 0; c < SLAB_NCLASSES; c++) {
+    slab_mag_t *const mag = tcache->mags[c];
+    if (mag == NULL)
+      continue;
+    if (mag->count == 0)
+      slab_stack_push(&slab_mags_empty, mag);
+    else
+      slab_depot_put(c, mag);
+    tcache->mags[c] = NULL;
+  }
+  tcache->bytes = 0;
+  tcache->registered = false;
+}
+
+static void slab_tcache_key_create(void) {
+  pthread_key_create(&slab_tcache_key, slab_tcache_flush);
+}
+
+// Get this thread's cache, making sure it'll be flushed when the thread exits
+static slab_tcache_t *slab_tcache_get(void) {
+  slab_tcache_t *const ret = &slab_tcache;
+  if (!ret->registered) {
+    pthread_once(&slab_tcache_key_once, slab_tcache_key_create);
+    pthread_setspecific(slab_tcache_key, ret);
+    ret->registered = true;
+  }
+  return ret;
+}
+
+// Try to allocate a slot from this thread's cache. This refills the cache if
+// it's empty, so it only fails if caching is disabled or we're out of memory.
+static uint8_t *slab_tcache_alloc(size_t class_idx) {
+  const size_t limit = curry_get_option(CURRY_OPTION_THREAD_CACHE);
+  const size_t slot_size = slab_class_sizes[class_idx];
+  if (limit < slot_size)
+    return NULL;
+  slab_tcache_t *const tcache = slab_tcache_get();
+  slab_mag_t *mag = tcache->mags[class_idx];
+
+  if (mag == NULL || mag->count == 0) {
+    // Prefer trading our empty magazine for a full one from the depot, as long
+    // as that doesn't put us over our limit
+    slab_mag_t *full = NULL;
+    if (tcache->bytes + SLAB_MAG_CAPACITY * slot_size <= limit)
+      full = slab_depot_take(class_idx);
+    if (full != NULL) {
+      if (mag != NULL)
+        slab_stack_push(&slab_mags_empty, mag);
+      mag = full;
+    } else {
+      // Otherwise, fill up the magazine from the chunks. We take as many as
+      // we're allowed to, up to half the magazine's capacity. That leaves room
+      // for frees.
+      if (mag == NULL && (mag = slab_mag_get_empty()) == NULL)
+        return NULL;
+      size_t want = (limit - tcache->bytes) / slot_size;
+      if (want > SLAB_MAG_CAPACITY / 2)
+        want = SLAB_MAG_CAPACITY / 2;
+      if (want == 0)
+        want = 1;
+      pthread_mutex_lock(&slab_lock);
+      while (mag->count < want) {
+        uint8_t *const slot = slab_alloc_locked(class_idx);
+        if (slot == NULL)
+          break;
+        mag->slots[mag->count++] = slot;
+      }
+      slab_chunk_t *const reclaimed = slab_reclaim_locked();
+      pthread_mutex_unlock(&slab_lock);
+      slab_chunks_destroy(reclaimed);
+    }
+    tcache->mags[class_idx] = mag;
+    tcache->bytes += mag->count * slot_size;
+    if (mag->count == 0)
+      return NULL;
+  }
+
+  tcache->bytes -= slot_size;
+  return mag->slots[--mag->count];
+}
+
+// Take a slot from this thread's cache without refilling it. Returns `NULL` if
+// the cache has nothing for this class.
+static uint8_t *slab_tcache_take(size_t class_idx) {
+  slab_mag_t *const mag = slab_tcache.mags[class_idx];
+  if (mag == NULL || mag->count == 0)
+    return NULL;
+  slab_tcache.bytes -= slab_class_sizes[class_idx];
+  return mag->slots[--mag->count];
+}
+
+// Try to free a slot into this thread's cache. This only fails if caching is
+// disabled, the cache is full, or we're out of memory.
+static bool slab_tcache_free(void *slot, size_t class_idx) {
+  const size_t limit = curry_get_option(CURRY_OPTION_THREAD_CACHE);
+  const size_t slot_size = slab_class_sizes[class_idx];
+  if (limit < slot_size)
+    return false;
+  slab_tcache_t *const tcache = slab_tcache_get();
+  slab_mag_t *mag = tcache->mags[class_idx];
+
+  // If our magazine is full, or keeping this slot would put us over our limit,
+  // hand the magazine off to the depot and start a new one
+  if (mag == NULL || mag->count == SLAB_MAG_CAPACITY ||
+      tcache->bytes + slot_size > limit) {
+    if (mag != NULL && mag->count == 0 && tcache->bytes + slot_size > limit)
+      return false;
+    slab_mag_t *const empty = slab_mag_get_empty();
+    if (empty == NULL)
+      return false;
+    if (mag != NULL) {
+      tcache->bytes -= mag->count * slot_size;
+      slab_depot_put(class_idx, mag);
+    }
+    tcache->mags[class_idx] = mag = empty;
+    // Other classes might be using up all of our limit
+    if (tcache->bytes + slot_size > limit)
+      return false;
+  }
+
+  mag->slots[mag->count++] = slot;
+  tcache->bytes += slot_size;
+  return true;
+}
+
+void curry_slab_free(void *slot) {
+  // Try the fast path first
+  slab_chunk_t *const chunk = slab_chunk_of(slot);
+  if (slab_tcache_free(slot, chunk->class_idx))
+    return;
+
+  // Never give memory back from here. This is often a one-shot thunk on its
+  // way back to its caller, and it shouldn't pay for system calls.
+  pthread_mutex_lock(&slab_lock);
+  slab_free_locked(slot);
+  pthread_mutex_unlock(&slab_lock);
+}
+
+bool curry_slab_reserve(size_t size, size_t count) {
+  const size_t max_class_idx = slab_class_for(size);
+  if (max_class_idx == SLAB_NCLASSES)
+    return false;
+
+  bool ret = true;
+  pthread_mutex_lock(&slab_lock);
+  for (size_t c = 0; c <= max_class_idx; c++) {
+    // Hold on to enough empty chunks for all the slots, and make sure we have
+    // that many
+    slab_class_t *const cls = &slab_classes[c];
+    const size_t nslots = slab_class_nslots(c);
+    const size_t want = (count + nslots - 1) / nslots;
+    if (cls->keep < want)
+      cls->keep = want;
+    while (cls->nempty < cls->keep) {
+      slab_chunk_t *const chunk = slab_chunk_create(c);
+      if (chunk == NULL) {
+        ret = false;
+        break;
+      }
+      slab_list_push(&cls->empty, chunk);
+      cls->nempty++;
+    }
+    // Allocation prefers partial chunks, so fault those in too
+    for (slab_chunk_t *chunk = cls->partial; chunk != NULL; chunk = chunk->next)
+      curry_heap_chunk_prefault(chunk->base, chunk->rw);
+    for (slab_chunk_t *chunk = cls->empty; chunk != NULL; chunk = chunk->next)
+      curry_heap_chunk_prefault(chunk->base, chunk->rw);
+  }
+  // Some chunks that were surplus might not be anymore
+  slab_nsurplus = 0;
+  for (size_t c = 0; c < SLAB_NCLASSES; c++) {
+    const slab_class_t *const cls = &slab_classes[c];
+    if (cls->nempty > cls->keep)
+      slab_nsurplus += cls->nempty - cls->keep;
+  }
+  pthread_mutex_unlock(&slab_lock);
+  return ret;
+}
+
+void curry_slab_trim(void) {
+  // Return the slots cached by this thread and by the depot to their chunks,
+  // so the chunks have a chance to be empty. Other threads' caches are their
+  // own.
+  for (size_t c = 0; c < SLAB_NCLASSES; c++) {
+    slab_mag_t *mag = slab_tcache.mags[c];
+    if (mag != NULL)
+      slab_mag_drain(mag);
+    while ((mag = slab_depot_take(c)) != NULL) {
+      slab_mag_drain(mag);
+      slab_stack_push(&slab_mags_empty, mag);
+    }
+  }
+  slab_tcache.bytes = 0;
+
+  // Give back every empty chunk, and forget about any reservations
+  slab_chunk_t *reclaimed = NULL;
+  pthread_mutex_lock(&slab_lock);
+  for (size_t c = 0; c < SLAB_NCLASSES; c++) {
+    slab_class_t *const cls = &slab_classes[c];
+    while (cls->empty != NULL) {
+      slab_chunk_t *const chunk = cls->empty;
+      slab_list_remove(&cls->empty, chunk);
+      chunk->next = reclaimed;
+      reclaimed = chunk;
+    }
+    cls->nempty = 0;
+    cls->keep = 1;
+  }
+  slab_nsurplus = 0;
+  pthread_mutex_unlock(&slab_lock);
+  slab_chunks_destroy(reclaimed);
+}
+
+uint8_t *curry_slab_writable(const uint8_t *slot) {
+  const slab_chunk_t *const chunk = slab_chunk_of(slot);
+  return chunk->rw + (slot - chunk->base);
+}
+
+bool curry_slab_owns(const void *ptr) { return curry_heap_contains(ptr); }
+
+size_t curry_slab_size_for(size_t size) {
+  const size_t class_idx = slab_class_for(size);
+  return class_idx == SLAB_NCLASSES ? 0 : slab_class_sizes[class_idx];
+}
+
+size_t curry_slab_slot_size(const void *ptr) {
+  if (!curry_slab_owns(ptr))
+    return 0;
+  // Chunks that aren't in use are zeroed, so they have no metadata. Otherwise,
+  // the first line of every chunk is its header.
+  const uint8_t *const p = ptr;
+  const slab_chunk_t *const chunk = slab_chunk_of(p);
+  if (chunk == NULL || p < chunk->base + SLAB_LINE_SIZE)
+    return 0;
+  const size_t slot_size = slab_class_sizes[chunk->class_idx];
+  const size_t offset = p - chunk->base - SLAB_LINE_SIZE;
+  if (offset % slot_size != 0 || offset / slot_size >= chunk->nslots)
+    return 0;
+  return slot_size;
+}
+
+const void *const *curry_slab_constants_of(const uint8_t *slot) {
+  const uintptr_t base = (uintptr_t)slot & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1);
+  return (const void *const *)(base + sizeof(slab_chunk_t *));
+}
@@ -0,0 +1,123 @@
+/**
+ * \file curry_slab.h
+ * \brief Slab allocator for executable thunk memory
+ *
+ * Thunks are small, so giving each one its own mapping wastes most of a page
+ * and burns through the kernel's limit on the number of mappings. Instead, this
+ * allocator carves large chunks of memory into cache-line aligned slots. Each
+ * chunk serves a single size class, and free slots are kept on a per-chunk free
+ * list.
+ *
+ * Slots are executable but never writable. To write to a slot, get its writable
+ * alias with `curry_slab_writable`. Writes through the alias are visible at the
+ * slot immediately.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Allocate a slot
+ * \param [in] size The minimum number of bytes needed
+ * \return A cache-line aligned slot, or `NULL` on failure
+ */
+uint8_t *curry_slab_alloc(size_t size);
+
+/**
+ * \brief Allocate many slots of the same size at once
+ *
+ * This only takes the allocator's lock once. Either all the slots are
+ * allocated, or none of them are.
+ *
+ * \param [in] size The minimum number of bytes needed for each slot
+ * \param [in] count The number of slots to allocate
+ * \param [out] out Where to write the slots
+ * \return Whether the allocation succeeded
+ */
+bool curry_slab_alloc_many(size_t size, size_t count, void **out);
+
+/**
+ * \brief Return a slot to its chunk
+ *
+ * It's safe to call from any thread, including from a thunk that's freeing
+ * itself.
+ *
+ * \param [in] slot A slot returned by `curry_slab_alloc`
+ */
+void curry_slab_free(void *slot);
+
+/**
+ * \brief Make room for slots ahead of time
+ *
+ * Afterwards, at least `count` more slots of every size up to `size` can be
+ * allocated without mapping or faulting in any memory. The room is kept even as
+ * slots are freed, until `curry_slab_trim`.
+ *
+ * \param [in] size The largest size of slot to make room for
+ * \param [in] count The number of slots of each size to make room for
+ * \return Whether all of the room could be made
+ */
+bool curry_slab_reserve(size_t size, size_t count);
+
+/**
+ * \brief Give unused memory back to the system
+ *
+ * This gives back every empty chunk, including ones kept by
+ * `curry_slab_reserve`, which no longer applies afterwards. Free slots cached
+ * by other threads aren't touched, so chunks holding them stay.
+ */
+void curry_slab_trim(void);
+
+/**
+ * \brief Get the writable alias of a slot
+ * \param [in] slot A slot returned by `curry_slab_alloc`
+ * \return An address that maps the same memory as `slot`, but is writable
+ */
+uint8_t *curry_slab_writable(const uint8_t *slot);
+
+/**
+ * \brief Check whether an address could be a slot
+ * \param [in] ptr The address to check
+ * \return Whether `ptr` points into memory managed by this allocator
+ */
+bool curry_slab_owns(const void *ptr);
+
+/**
+ * \brief Get the size of the slots that would be used for an allocation
+ * \param [in] size The minimum number of bytes needed
+ * \return The size of the slot `curry_slab_alloc` would return, or zero if the
+ * allocation is too large
+ */
+size_t curry_slab_size_for(size_t size);
+
+/**
+ * \brief Get the size of a slot
+ * \param [in] ptr An address that might be the start of a slot
+ * \return The size of the slot starting at `ptr`, or zero if `ptr` isn't the
+ * start of a slot
+ */
+size_t curry_slab_slot_size(const void *ptr);
+
+/**
+ * \brief Number of constants copied into every chunk
+ * \see curry_slab_constants
+ */
+#define CURRY_SLAB_NCONSTANTS (3)
+
+/**
+ * \brief Values copied into the start of every chunk
+ *
+ * Code in a slot can't reach arbitrary addresses with RIP-relative addressing,
+ * but it can always reach the start of its own chunk. So, values that code
+ * needs often are kept there. The user of this allocator defines them.
+ */
+extern void *const curry_slab_constants[CURRY_SLAB_NCONSTANTS];
+
+/**
+ * \brief Find the copy of `curry_slab_constants` for a slot
+ * \param [in] slot A slot returned by `curry_slab_alloc`
+ * \return The address of the copy in the slot's chunk, as seen by the slot
+ */
+const void *const *curry_slab_constants_of(const uint8_t *slot);
@@ -0,0 +1,147 @@
+#include "curry_stats.h"
+#include "curry.h"
+#include "curry_heap.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Counters for a single thread. Only the owning thread ever writes them, so it
+// doesn't need atomic read-modify-writes. It still stores with atomics so that
+// readers on other threads never see a torn value.
+typedef struct stats_thread_t {
+  struct stats_thread_t *prev;
+  struct stats_thread_t *next;
+  bool registered;
+  uint64_t created;
+  uint64_t freed;
+  uint64_t bytes_created;
+  uint64_t bytes_freed;
+  uint64_t failures[CURRY_FAILURE_COUNT];
+  uint64_t sizes[CURRY_STATS_SIZE_BUCKETS];
+} stats_thread_t;
+
+// Every thread that has touched its counters is on this list. When a thread
+// exits, its counters are folded into `stats_exited` and it's taken off the
+// list. Both are protected by the lock.
+static __thread stats_thread_t stats_local;
+static stats_thread_t *stats_threads = NULL;
+static stats_thread_t stats_exited;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+// Used to fold a thread's counters when it exits
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+// Add one set of counters to another. The source might be changing while this
+// runs, so it's read with atomics.
+static void stats_accumulate(stats_thread_t *dst, const stats_thread_t *src) {
+#define ACC(field)                                                             \
+  dst->field += __atomic_load_n(&src->field, __ATOMIC_RELAXED)
+  ACC(created);
+  ACC(freed);
+  ACC(bytes_created);
+  ACC(bytes_freed);
+  for (size_t i = 0; i < CURRY_FAILURE_COUNT; i++)
+    ACC(failures[i]);
+  for (size_t i = 0; i < CURRY_STATS_SIZE_BUCKETS; i++)
+    ACC(sizes[i]);
+#undef ACC
+}
+
+static void stats_thread_exit(void *arg) {
+  stats_thread_t *const self = arg;
+  pthread_mutex_lock(&stats_lock);
+  stats_accumulate(&stats_exited, self);
+  if (self->prev != NULL)
+    self->prev->next = self->next;
+  else
+    stats_threads = self->next;
+  if (self->next != NULL)
+    self->next->prev = self->prev;
+  pthread_mutex_unlock(&stats_lock);
+  // If this thread frees any more thunks, it'll register itself again
+  memset(self, 0, sizeof(*self));
+}
+
+static void stats_key_create(void) {
+  pthread_key_create(&stats_key, stats_thread_exit);
+}
+
+// Get this thread's counters, putting them on the list the first time
+static stats_thread_t *stats_get(void) {
+  stats_thread_t *const self = &stats_local;
+  if (__builtin_expect(!self->registered, false)) {
+    pthread_once(&stats_key_once, stats_key_create);
+    pthread_setspecific(stats_key, self);
+    pthread_mutex_lock(&stats_lock);
+    self->prev = NULL;
+    self->next = stats_threads;
+    if (stats_threads != NULL)
+      stats_threads->prev = self;
+    stats_threads = self;
+    pthread_mutex_unlock(&stats_lock);
+    self->registered = true;
+  }
+  return self;
+}
+
+// Bump a counter owned by this thread
+static void stats_add(uint64_t *counter, uint64_t n) {
+  __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+// Find the histogram bucket for a slot size
+static size_t stats_bucket(size_t slot_size) {
+  size_t bucket = 0;
+  while (bucket < CURRY_STATS_SIZE_BUCKETS - 1 &&
+         slot_size > (UINT64_C(64) << bucket))
+    bucket++;
+  return bucket;
+}
+
+void curry_stats_created(size_t slot_size, size_t count) {
+  stats_thread_t *const self = stats_get();
+  stats_add(&self->created, count);
+  stats_add(&self->bytes_created, slot_size * count);
+  stats_add(&self->sizes[stats_bucket(slot_size)], count);
+}
+
+void curry_stats_freed(size_t slot_size) {
+  stats_thread_t *const self = stats_get();
+  stats_add(&self->freed, 1);
+  stats_add(&self->bytes_freed, slot_size);
+}
+
+void curry_stats_freed_many(size_t bytes, size_t count) {
+  stats_thread_t *const self = stats_get();
+  stats_add(&self->freed, count);
+  stats_add(&self->bytes_freed, bytes);
+}
+
+void curry_stats_failed(curry_failure_t reason) {
+  stats_add(&stats_get()->failures[reason], 1);
+}
+
+void curry_stats(curry_stats_t *stats) {
+  stats_thread_t total = {0};
+  pthread_mutex_lock(&stats_lock);
+  stats_accumulate(&total, &stats_exited);
+  for (const stats_thread_t *t = stats_threads; t != NULL; t = t->next)
+    stats_accumulate(&total, t);
+  pthread_mutex_unlock(&stats_lock);
+
+  // A thunk can be freed on a different thread from the one that created it.
+  // If we read the freeing thread's counters after the creating thread's, we
+  // might see the free without the creation. Don't report negative numbers.
+  stats->created = total.created;
+  stats->freed = total.freed;
+  stats->live = total.created > total.freed ? total.created - total.freed : 0;
+  stats->bytes_used = total.bytes_created > total.bytes_freed
+                          ? total.bytes_created - total.bytes_freed
+                          : 0;
+  stats->bytes_mapped = curry_heap_bytes_in_use();
+  memcpy(stats->failures, total.failures, sizeof(stats->failures));
+  memcpy(stats->sizes, total.sizes, sizeof(stats->sizes));
+}
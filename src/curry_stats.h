@@ -0,0 +1,63 @@
+/**
+ * \file curry_stats.h
+ * \brief Counters and tracing hooks for thunk churn
+ *
+ * Counters are kept per thread, so bumping them never contends with other
+ * threads. They're only summed up when someone asks for them with
+ * `curry_stats`.
+ *
+ * If `<sys/sdt.h>` is available, creating and freeing a thunk also fires a USDT
+ * probe in the `curry` provider. Probes are just a `nop` until a tracer
+ * attaches to them. Define `CURRY_NO_PROBES` to leave them out entirely.
+ */
+#pragma once
+
+#include "curry.h"
+
+#include <stddef.h>
+
+#if !defined(CURRY_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CURRY_HAVE_PROBES
+#endif
+#endif
+
+/**
+ * \brief Fire a USDT probe in the `curry` provider
+ *
+ * These do nothing if probes aren't available.
+ */
+#ifdef CURRY_HAVE_PROBES
+#define CURRY_PROBE1(name, a1) STAP_PROBE1(curry, name, a1)
+#define CURRY_PROBE2(name, a1, a2) STAP_PROBE2(curry, name, a1, a2)
+#else
+#define CURRY_PROBE1(name, a1) ((void)(a1))
+#define CURRY_PROBE2(name, a1, a2) ((void)(a1), (void)(a2))
+#endif
+
+/**
+ * \brief Record that thunks were created
+ * \param [in] slot_size The size of the slot each thunk occupies
+ * \param [in] count The number of thunks
+ */
+void curry_stats_created(size_t slot_size, size_t count);
+
+/**
+ * \brief Record that a thunk was freed
+ * \param [in] slot_size The size of the slot the thunk occupied
+ */
+void curry_stats_freed(size_t slot_size);
+
+/**
+ * \brief Record that many thunks were freed at once
+ * \param [in] bytes The total size of the thunks
+ * \param [in] count The number of thunks
+ */
+void curry_stats_freed_many(size_t bytes, size_t count);
+
+/**
+ * \brief Record that creating thunks failed
+ * \param [in] reason Why it failed
+ */
+void curry_stats_failed(curry_failure_t reason);
@@ -0,0 +1,114 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint64_t dut_sub(uint64_t a, uint64_t b) { return a - b; }
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7;
+}
+static uint64_t dut_count(uint64_t *counter, uint64_t amount) {
+  *counter += amount;
+  return 0;
+}
+
+// Takes its argument count first, and checks that the rest of the arguments
+// count up from one in the upper and lower halves, then returns the last one
+#define SEQ(i) ((uint64_t)(i) << 32 | (i))
+static uint64_t dut_sequence(uint64_t nargs, ...) {
+  va_list args;
+  va_start(args, nargs);
+  uint64_t last = 0;
+  for (uint64_t i = 1; i <= nargs; i++) {
+    last = va_arg(args, uint64_t);
+    TEST_ASSERT_EQUAL_UINT64(SEQ(i), last);
+  }
+  va_end(args);
+  return last;
+}
+
+// Check every split of arguments between bound and per-row, including ones
+// that put both kinds on the stack
+void test_apply(void) {
+  enum { NROWS = 100 };
+  const uint64_t args_now[8] = {1, 2, 3, 4, 5, 6, 7, UINT64_C(1) << 40};
+  for (size_t nargs_now = 0; nargs_now <= 8; nargs_now++) {
+    const size_t nargs_later = 8 - nargs_now;
+    uint64_t rows[NROWS * 8];
+    uint64_t results[NROWS];
+    for (size_t i = 0; i < NROWS * nargs_later; i++)
+      rows[i] = i;
+    TEST_ASSERT_TRUE(curry_apply_many(dut_args8, nargs_now, nargs_later,
+                                      args_now, rows, NROWS, results));
+    for (size_t r = 0; r < NROWS; r++) {
+      uint64_t args[8];
+      for (size_t i = 0; i < 8; i++)
+        args[i] = i < nargs_now ? args_now[i]
+                                : rows[r * nargs_later + i - nargs_now];
+      TEST_ASSERT_EQUAL_UINT64(dut_args8(args[0], args[1], args[2], args[3],
+                                         args[4], args[5], args[6], args[7]),
+                               results[r]);
+    }
+  }
+}
+
+// Check that long runs of stack arguments are copied correctly, whether
+// they're bound or come from the rows
+void test_long(void) {
+  uint64_t args[32] = {31};
+  for (uint64_t i = 1; i < 32; i++)
+    args[i] = SEQ(i);
+  for (size_t nargs_now = 1; nargs_now <= 32; nargs_now += 31) {
+    const size_t nargs_later = 32 - nargs_now;
+    uint64_t rows[2 * 32];
+    for (size_t r = 0; r < 2; r++) {
+      for (size_t i = 0; i < nargs_later; i++)
+        rows[r * nargs_later + i] = args[nargs_now + i];
+    }
+    uint64_t results[2] = {0};
+    TEST_ASSERT_TRUE(curry_apply_many(dut_sequence, nargs_now, nargs_later,
+                                      args, rows, 2, results));
+    TEST_ASSERT_EQUAL_UINT64(SEQ(31), results[0]);
+    TEST_ASSERT_EQUAL_UINT64(SEQ(31), results[1]);
+  }
+}
+
+// Check that persistent thunks are called through, and that results can be
+// discarded
+void test_thunk(void) {
+  void *const sub = curry_persistent(dut_sub, 1, 1, 100);
+  TEST_ASSERT_NOT_NULL(sub);
+  const uint64_t rows[3] = {1, 2, 3};
+  uint64_t results[3];
+  TEST_ASSERT_TRUE(curry_apply_many(sub, 0, 1, NULL, rows, 3, results));
+  TEST_ASSERT_EQUAL_UINT64(99, results[0]);
+  TEST_ASSERT_EQUAL_UINT64(98, results[1]);
+  TEST_ASSERT_EQUAL_UINT64(97, results[2]);
+  curry_free(sub);
+
+  uint64_t counter = 0;
+  const uint64_t args_now[1] = {(uintptr_t)&counter};
+  TEST_ASSERT_TRUE(
+      curry_apply_many(dut_count, 1, 1, args_now, rows, 3, NULL));
+  TEST_ASSERT_EQUAL_UINT64(6, counter);
+}
+
+// Check the degenerate cases
+void test_edges(void) {
+  TEST_ASSERT_TRUE(curry_apply_many(dut_sub, 0, 2, NULL, NULL, 0, NULL));
+  TEST_ASSERT_FALSE(curry_apply_many(dut_sub, CURRY_MAX_ARGS, 1, NULL, NULL,
+                                     1, NULL));
+
+  // Rows with no arguments still make calls
+  const uint64_t args_now[2] = {10, 3};
+  uint64_t results[4] = {0};
+  TEST_ASSERT_TRUE(curry_apply_many(dut_sub, 2, 0, args_now, NULL, 4, results));
+  for (size_t i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL_UINT64(7, results[i]);
+}
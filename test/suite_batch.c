@@ -0,0 +1,62 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "curry.h"
+#include "unity.h"
+
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  TEST_ASSERT_EQUAL_UINT64(a1, a0 + 1);
+  TEST_ASSERT_EQUAL_UINT64(a2, a0 + 2);
+  TEST_ASSERT_EQUAL_UINT64(a3, a0 + 3);
+  TEST_ASSERT_EQUAL_UINT64(a4, a0 + 4);
+  TEST_ASSERT_EQUAL_UINT64(a5, a0 + 5);
+  TEST_ASSERT_EQUAL_UINT64(a6, a0 + 6);
+  TEST_ASSERT_EQUAL_UINT64(a7, a0 + 7);
+  return a0;
+}
+
+// Check that the array version works without a `va_list`, including for
+// now-overflow-args
+void test_array_7_1(void) {
+  const uint64_t args[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6};
+  uint64_t (*const curried)(uint64_t) = curry_array(dut_args8, 7, 1, args);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(0x0, curried(0x7));
+}
+
+// Check that every thunk in a batch gets its own arguments
+void test_batch_2_6(void) {
+  const size_t count = 1000;
+  uint64_t *const args = calloc(2 * count, sizeof(uint64_t));
+  void **const out = calloc(count, sizeof(void *));
+  TEST_ASSERT_NOT_NULL(args);
+  TEST_ASSERT_NOT_NULL(out);
+  for (size_t i = 0; i < count; i++) {
+    args[2 * i + 0] = 8 * i;
+    args[2 * i + 1] = 8 * i + 1;
+  }
+  TEST_ASSERT_TRUE(curry_batch_persistent(dut_args8, 2, 6, args, count, out));
+  for (size_t r = 0; r < 2; r++) {
+    for (size_t i = 0; i < count; i++) {
+      uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t,
+                                uint64_t, uint64_t) = out[i];
+      const uint64_t b = 8 * i;
+      TEST_ASSERT_EQUAL_UINT64(
+          b, curried(b + 2, b + 3, b + 4, b + 5, b + 6, b + 7));
+    }
+  }
+  for (size_t i = 0; i < count; i++)
+    curry_free(out[i]);
+  free(out);
+  free(args);
+}
+
+// Check that batches fail as a unit
+void test_batch_too_many(void) {
+  const uint64_t args[2] = {0};
+  void *out[2] = {NULL, NULL};
+  TEST_ASSERT_FALSE(curry_batch(dut_args8, 1, CURRY_MAX_ARGS, args, 2, out));
+  TEST_ASSERT_NULL(out[0]);
+  TEST_ASSERT_NULL(out[1]);
+}
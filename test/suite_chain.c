@@ -49,3 +49,37 @@ void test_args16_7_7_2(void) {
   TEST_ASSERT_NOT_NULL(curry2);
   TEST_ASSERT_EQUAL_UINT64(0xff, ((uint64_t(*)(void))curry2)());
 }
+
+static uint64_t dut_args3(uint64_t a0, uint64_t a1, uint64_t a2) {
+  TEST_ASSERT_EQUAL_UINT64(a0, 0x0);
+  TEST_ASSERT_EQUAL_UINT64(a1, 0x1);
+  TEST_ASSERT_EQUAL_UINT64(a2, 0x2);
+  return 0xff;
+}
+
+// Check that currying a persistent thunk doesn't depend on it sticking around,
+// since the new thunk should call the original function directly
+void test_args3_fused_persistent(void) {
+  void *curry0 = curry_persistent(dut_args3, 1, 2, 0x0);
+  TEST_ASSERT_NOT_NULL(curry0);
+  void *curry1 = curry_persistent(curry0, 1, 1, 0x1);
+  TEST_ASSERT_NOT_NULL(curry1);
+  curry_free(curry0);
+  for (size_t i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL_UINT64(0xff, ((uint64_t(*)(uint64_t))curry1)(0x2));
+  curry_free(curry1);
+}
+
+// Check that a one-shot thunk that was fused into another is freed once the
+// outer thunk is called
+void test_args3_fused_oneshot(void) {
+  void *curry0 = curry(dut_args3, 1, 2, 0x0);
+  TEST_ASSERT_NOT_NULL(curry0);
+  void *curry1 = curry(curry0, 1, 1, 0x1);
+  TEST_ASSERT_NOT_NULL(curry1);
+  TEST_ASSERT_EQUAL_UINT64(0xff, ((uint64_t(*)(uint64_t))curry1)(0x2));
+  void *curry2 = curry(dut_args3, 1, 2, 0x0);
+  TEST_ASSERT_EQUAL_PTR(curry0, curry2);
+  TEST_ASSERT_EQUAL_UINT64(
+      0xff, ((uint64_t(*)(uint64_t, uint64_t))curry2)(0x1, 0x2));
+}
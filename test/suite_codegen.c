@@ -0,0 +1,74 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7;
+}
+
+// Takes its argument count first, and checks that the rest of the arguments
+// count up from one in the upper and lower halves
+#define SEQ(i) ((uint64_t)(i) << 32 | (i))
+static uint64_t dut_sequence(uint64_t nargs, ...) {
+  va_list args;
+  va_start(args, nargs);
+  for (uint64_t i = 1; i <= nargs; i++)
+    TEST_ASSERT_EQUAL_UINT64(SEQ(i), va_arg(args, uint64_t));
+  va_end(args);
+  return nargs;
+}
+
+static const uint8_t endbr64[4] = {0xf3, 0x0f, 0x1e, 0xfa};
+
+// Check that the choices are made once, and that AVX is only used if it can be
+void test_info(void) {
+  curry_codegen_info_t first, second;
+  curry_codegen_info(&first);
+  curry_codegen_info(&second);
+  TEST_ASSERT_EQUAL(first.endbr, second.endbr);
+  TEST_ASSERT_EQUAL(first.avx_copy, second.avx_copy);
+  TEST_ASSERT_EQUAL(__builtin_cpu_supports("avx") != 0, first.avx_copy);
+}
+
+// Check that thunks start with `endbr64` exactly when they're supposed to, and
+// that frames are set up with `push` rather than `enter`
+void test_prologue(void) {
+  curry_codegen_info_t info;
+  curry_codegen_info(&info);
+  const uint8_t *const frameless = curry_persistent(dut_args8, 1, 7, 1);
+  const uint8_t *const framed =
+      curry_persistent(dut_args8, 8, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  TEST_ASSERT_NOT_NULL(frameless);
+  TEST_ASSERT_NOT_NULL(framed);
+  TEST_ASSERT_EQUAL(info.endbr, memcmp(frameless, endbr64, 4) == 0);
+  TEST_ASSERT_EQUAL(info.endbr, memcmp(framed, endbr64, 4) == 0);
+  // Emit: push %rbp
+  TEST_ASSERT_EQUAL_UINT64(0x55, framed[info.endbr ? 4 : 0]);
+  TEST_ASSERT_EQUAL_UINT64(8, ((uint64_t(*)(void))framed)());
+  curry_free((void *)frameless);
+  curry_free((void *)framed);
+}
+
+// Check that blocks of every length modulo the vector size are copied
+// correctly, whether or not they're copied with AVX
+void test_copy(void) {
+  uint64_t args[24] = {0};
+  for (uint64_t i = 1; i < 24; i++)
+    args[i] = SEQ(i);
+  for (uint64_t nargs = 14; nargs < 24; nargs++) {
+    args[0] = nargs - 1;
+    uint64_t (*const curried)(void) =
+        curry_array_persistent(dut_sequence, nargs, 0, args);
+    TEST_ASSERT_NOT_NULL(curried);
+    TEST_ASSERT_EQUAL_UINT64(nargs - 1, curried());
+    curry_free(curried);
+  }
+}
@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint64_t dut_add(uint64_t a, uint64_t b) { return a + b; }
+static uint64_t dut_sub(uint64_t a, uint64_t b) { return a - b; }
+static uint64_t dut_mul(uint64_t a, uint64_t b) { return a * b; }
+static uint64_t dut_negate(uint64_t a) { return -a; }
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7;
+}
+
+// Check that plain functions are composed in the right order
+void test_compose(void) {
+  uint64_t (*const composed)(uint64_t, uint64_t) =
+      curry_compose(dut_negate, dut_add, 2);
+  TEST_ASSERT_NOT_NULL(composed);
+  TEST_ASSERT_EQUAL_UINT64(-7, composed(3, 4));
+  TEST_ASSERT_EQUAL_UINT64(0, composed(3, -3));
+  curry_free(composed);
+}
+
+// Check that curried stages have their arguments copied, so the pipeline still
+// works once they're gone, and that the result is passed last
+void test_bound(void) {
+  void *const sub = curry_persistent(dut_sub, 1, 1, 10);
+  void *const mul = curry_persistent(dut_mul, 1, 1, 3);
+  TEST_ASSERT_NOT_NULL(sub);
+  TEST_ASSERT_NOT_NULL(mul);
+  uint64_t (*const composed)(uint64_t) = curry_compose(mul, sub, 1);
+  uint64_t (*const reversed)(uint64_t) = curry_compose(sub, mul, 1);
+  curry_free(sub);
+  curry_free(mul);
+  TEST_ASSERT_NOT_NULL(composed);
+  TEST_ASSERT_NOT_NULL(reversed);
+  TEST_ASSERT_EQUAL_UINT64(18, composed(4));
+  TEST_ASSERT_EQUAL_UINT64(-2, reversed(4));
+  curry_free(composed);
+  curry_free(reversed);
+}
+
+// Check a pipeline whose stages pass arguments on the stack, both coming in and
+// going out, including the last stage
+void test_pipeline(void) {
+  void *const stages[4] = {
+      dut_args8,
+      curry_persistent(dut_args8, 7, 1, 1, 1, 1, 1, 1, 1, 1),
+      curry_persistent(dut_sub, 1, 1, 1000),
+      curry_persistent(dut_args8, 7, 1, 0, 0, 0, 0, 0, 0, 0),
+  };
+  for (size_t i = 1; i < 4; i++)
+    TEST_ASSERT_NOT_NULL(stages[i]);
+  uint64_t (*const pipeline)(uint64_t, uint64_t, uint64_t, uint64_t,
+                             uint64_t, uint64_t, uint64_t, uint64_t) =
+      curry_pipeline(stages, 4, 8);
+  TEST_ASSERT_NOT_NULL(pipeline);
+  const uint64_t first = dut_args8(1, 2, 3, 4, 5, 6, 7, 8);
+  const uint64_t expected = 8 * (1000 - (28 + 8 * first));
+  TEST_ASSERT_EQUAL_UINT64(expected, pipeline(1, 2, 3, 4, 5, 6, 7, 8));
+  curry_free(pipeline);
+  for (size_t i = 1; i < 4; i++)
+    curry_free(stages[i]);
+}
+
+// Check that currying a pipeline calls it, instead of fusing with it, and that
+// a pipeline stage that's a pipeline is called too
+void test_nested(void) {
+  void *const mul = curry_persistent(dut_mul, 1, 1, 3);
+  TEST_ASSERT_NOT_NULL(mul);
+  void *const composed = curry_compose(dut_negate, dut_add, 2);
+  TEST_ASSERT_NOT_NULL(composed);
+  uint64_t (*const curried)(uint64_t) = curry_persistent(composed, 1, 1, 5);
+  uint64_t (*const outer)(uint64_t, uint64_t) =
+      curry_compose(mul, composed, 2);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_NOT_NULL(outer);
+  TEST_ASSERT_EQUAL_UINT64(-7, curried(2));
+  TEST_ASSERT_EQUAL_UINT64(-21, outer(3, 4));
+  curry_free(outer);
+  curry_free(curried);
+  curry_free(composed);
+  curry_free(mul);
+}
+
+// Check the degenerate cases, and that shapes that don't match are called
+// rather than skipped
+void test_edges(void) {
+  void *const stages[2] = {dut_negate, dut_negate};
+  TEST_ASSERT_NULL(curry_pipeline(stages, 0, 1));
+  TEST_ASSERT_EQUAL_PTR(dut_negate, curry_pipeline(stages, 1, 1));
+
+  // This thunk takes no arguments, so as the first stage of a pipeline taking
+  // one, it has to be called as-is
+  void *const constant = curry_persistent(dut_add, 2, 0, 40, 2);
+  TEST_ASSERT_NOT_NULL(constant);
+  uint64_t (*const composed)(uint64_t) =
+      curry_compose(dut_negate, constant, 1);
+  TEST_ASSERT_NOT_NULL(composed);
+  TEST_ASSERT_EQUAL_UINT64(-42, composed(7));
+  curry_free(composed);
+  curry_free(constant);
+}
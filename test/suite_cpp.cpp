@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "curry.hpp"
+#include "unity.h"
+
+static std::uint64_t dut_sub(std::uint64_t a0, std::uint64_t a1) {
+  return a0 - a1;
+}
+static std::int64_t dut_signed(std::int64_t a0, int a1) { return a0 * a1; }
+static const char *dut_index(const char *s, std::size_t i) { return s + i; }
+static double dut_half(std::uint64_t a0) noexcept { return a0 / 2.0; }
+static double dut_lerp(float t, double a, std::int64_t b) {
+  return a + t * (b - a);
+}
+static std::uint64_t dut_weigh(std::uint64_t a0, std::uint64_t a1,
+                               std::uint64_t a2, std::uint64_t a3,
+                               std::uint64_t a4, std::uint64_t a5,
+                               std::uint64_t a6, std::uint64_t a7) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7;
+}
+
+// Check that the thunk's type is the rest of the function's parameters
+static_assert(std::is_same_v<decltype(curry_cpp::bind<&dut_sub>(1)),
+                             curry_cpp::thunk<std::uint64_t(std::uint64_t)>>);
+static_assert(std::is_same_v<decltype(curry_cpp::bind<&dut_sub>()),
+                             curry_cpp::thunk<std::uint64_t(std::uint64_t,
+                                                        std::uint64_t)>>);
+static_assert(std::is_same_v<decltype(curry_cpp::bind<&dut_half>(1)),
+                             curry_cpp::thunk<double()>>);
+static_assert(!std::is_copy_constructible_v<curry_cpp::thunk<void()>>);
+
+// Check that arguments of each kind make it through
+void test_kinds(void) {
+  auto sub = curry_cpp::bind<&dut_sub>(100);
+  TEST_ASSERT_TRUE(static_cast<bool>(sub));
+  TEST_ASSERT_EQUAL_UINT64(99, sub(1));
+  TEST_ASSERT_EQUAL_UINT64(98, sub(2));
+
+  auto neg = curry_cpp::bind<&dut_signed>(-3);
+  TEST_ASSERT_EQUAL(-12, neg(4));
+  TEST_ASSERT_EQUAL(6, neg(-2));
+
+  const char *const str = "curry";
+  auto idx = curry_cpp::bind<&dut_index>(str);
+  TEST_ASSERT_EQUAL_PTR(str + 2, idx(2));
+
+  auto half = curry_cpp::bind<&dut_half>(5);
+  TEST_ASSERT_EQUAL_DOUBLE(2.5, half());
+
+  auto lerp = curry_cpp::bind<&dut_lerp>(0.25, 2);
+  TEST_ASSERT_EQUAL_DOUBLE(4.5, lerp(12));
+}
+
+// Check that arguments split across registers and the stack work
+void test_stack(void) {
+  auto all = curry_cpp::bind<&dut_weigh>(1, 1, 1, 1, 1, 1, 1, 1);
+  auto some = curry_cpp::bind<&dut_weigh>(1, 1, 1);
+  TEST_ASSERT_EQUAL_UINT64(36, all());
+  TEST_ASSERT_EQUAL_UINT64(36 + 8, some(1, 1, 1, 1, 2));
+}
+
+// Check that binding nothing just hands back the function
+void test_nothing(void) {
+  auto sub = curry_cpp::bind<&dut_sub>();
+  TEST_ASSERT_TRUE(sub.get() == &dut_sub);
+  TEST_ASSERT_EQUAL_UINT64(1, sub(3, 2));
+}
+
+// Check that thunks are freed exactly once, however ownership moves around
+void test_ownership(void) {
+  curry_stats_t before, during, after;
+  curry_stats(&before);
+  {
+    auto t0 = curry_cpp::bind<&dut_sub>(1);
+    auto t1 = std::move(t0);
+    TEST_ASSERT_FALSE(static_cast<bool>(t0));
+    TEST_ASSERT_EQUAL_UINT64(1, t1(0));
+    curry_cpp::thunk<std::uint64_t(std::uint64_t)> t2;
+    t2 = std::move(t1);
+    TEST_ASSERT_EQUAL_UINT64(1, t2(0));
+
+    auto t3 = curry_cpp::bind<&dut_sub>(2);
+    auto *const raw = t3.release();
+    TEST_ASSERT_FALSE(static_cast<bool>(t3));
+    curry_stats(&during);
+    TEST_ASSERT_EQUAL_UINT64(before.live + 2, during.live);
+    curry_free(reinterpret_cast<void *>(raw));
+  }
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}
@@ -0,0 +1,233 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define I CURRY_ARG_INTEGER
+#define D CURRY_ARG_DOUBLE
+#define F CURRY_ARG_FLOAT
+
+static double dut_axpy(double a, double x, double y) { return a * x + y; }
+static double dut_mixed(int64_t a0, double a1, int64_t a2, double a3) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3;
+}
+static float dut_floats(float a0, float a1, float a2, float a3, float a4,
+                        float a5, float a6, float a7, float a8) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7 +
+         9 * a8;
+}
+static int64_t dut_truncate(double a0, int64_t a1) { return (int64_t)a0 + a1; }
+
+// Eight integers and ten doubles, so both kinds spill onto the stack
+static const curry_arg_class_t many_classes[18] = {
+    I, D, I, D, I, D, I, D, I, D, I, D, I, D, I, D, D, D,
+};
+static double dut_many(int64_t a0, double a1, int64_t a2, double a3,
+                       int64_t a4, double a5, int64_t a6, double a7,
+                       int64_t a8, double a9, int64_t a10, double a11,
+                       int64_t a12, double a13, int64_t a14, double a15,
+                       double a16, double a17) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7 +
+         9 * a8 + 10 * a9 + 11 * a10 + 12 * a11 + 13 * a12 + 14 * a13 +
+         15 * a14 + 16 * a15 + 17 * a16 + 18 * a17;
+}
+
+// Check that bound doubles end up in XMM registers, and later ones are moved
+// over to make room
+void test_doubles(void) {
+  const curry_arg_class_t classes[] = {D, D, D};
+  double (*const axpy)(double, double) =
+      curry_typed_persistent(dut_axpy, 1, 2, classes, 2.0);
+  double (*const zero)(double, double) =
+      curry_typed_persistent(dut_axpy, 1, 2, classes, 0.0);
+  TEST_ASSERT_NOT_NULL(axpy);
+  TEST_ASSERT_NOT_NULL(zero);
+  TEST_ASSERT_TRUE(axpy(3.0, 1.0) == 7.0);
+  TEST_ASSERT_TRUE(axpy(-0.25, -1.0) == -1.5);
+  TEST_ASSERT_TRUE(zero(3.0, 1.0) == 1.0);
+  curry_free(axpy);
+  curry_free(zero);
+}
+
+// Check that integers and doubles are counted separately
+void test_mixed(void) {
+  const curry_arg_class_t classes[] = {I, D, I, D};
+  double (*const one)(double, int64_t, double) =
+      curry_typed_persistent(dut_mixed, 1, 3, classes, (int64_t)1);
+  double (*const two)(int64_t, double) =
+      curry_typed_persistent(dut_mixed, 2, 2, classes, (int64_t)1, 0.5);
+  double (*const three)(double) =
+      curry_typed_persistent(dut_mixed, 3, 1, classes, (int64_t)1, 0.5,
+                             (int64_t)-2);
+  TEST_ASSERT_NOT_NULL(one);
+  TEST_ASSERT_NOT_NULL(two);
+  TEST_ASSERT_NOT_NULL(three);
+  TEST_ASSERT_TRUE(one(0.5, -2, 0.25) == 1 + 1 - 6 + 1);
+  TEST_ASSERT_TRUE(two(-2, 0.25) == 1 + 1 - 6 + 1);
+  TEST_ASSERT_TRUE(three(0.25) == 1 + 1 - 6 + 1);
+  curry_free(one);
+  curry_free(two);
+  curry_free(three);
+}
+
+// Check that floats are bound as floats, even though they're passed to us as
+// doubles, including when they spill onto the stack
+void test_floats(void) {
+  const curry_arg_class_t classes[] = {F, F, F, F, F, F, F, F, F};
+  float (*const first)(float, float, float, float, float, float, float,
+                       float) =
+      curry_typed_persistent(dut_floats, 1, 8, classes, 1.5f);
+  float (*const last)(float) = curry_typed_persistent(
+      dut_floats, 8, 1, classes, 1.5f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f,
+      1.0f);
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_NOT_NULL(last);
+  const float expected =
+      dut_floats(1.5f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.5f);
+  TEST_ASSERT_TRUE(first(1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.5f) ==
+                   expected);
+  TEST_ASSERT_TRUE(last(0.5f) == expected);
+  curry_free(first);
+  curry_free(last);
+}
+
+// Check every way arguments can move when there are too many of both kinds for
+// the registers
+void test_spill(void) {
+  const double expected =
+      dut_many(1, 0.5, 2, 1.5, 3, 2.5, 4, 3.5, 5, 4.5, 6, 5.5, 7, 6.5, 8, 7.5,
+               8.5, 9.5);
+
+  double (*const few)(double, int64_t, double, int64_t, double, int64_t,
+                      double, int64_t, double, int64_t, double, int64_t,
+                      double, int64_t, double, double, double) =
+      curry_typed_persistent(dut_many, 1, 17, many_classes, (int64_t)1);
+  TEST_ASSERT_NOT_NULL(few);
+  TEST_ASSERT_TRUE(few(0.5, 2, 1.5, 3, 2.5, 4, 3.5, 5, 4.5, 6, 5.5, 7, 6.5, 8,
+                       7.5, 8.5, 9.5) == expected);
+  curry_free(few);
+
+  double (*const half)(int64_t, double, int64_t, double, int64_t, double,
+                       int64_t, double, double, double) =
+      curry_typed_persistent(dut_many, 8, 10, many_classes, (int64_t)1, 0.5,
+                             (int64_t)2, 1.5, (int64_t)3, 2.5, (int64_t)4,
+                             3.5);
+  TEST_ASSERT_NOT_NULL(half);
+  TEST_ASSERT_TRUE(half(5, 4.5, 6, 5.5, 7, 6.5, 8, 7.5, 8.5, 9.5) ==
+                   expected);
+  curry_free(half);
+
+  double (*const all)(void) = curry_typed_persistent(
+      dut_many, 18, 0, many_classes, (int64_t)1, 0.5, (int64_t)2, 1.5,
+      (int64_t)3, 2.5, (int64_t)4, 3.5, (int64_t)5, 4.5, (int64_t)6, 5.5,
+      (int64_t)7, 6.5, (int64_t)8, 7.5, 8.5, 9.5);
+  TEST_ASSERT_NOT_NULL(all);
+  TEST_ASSERT_TRUE(all() == expected);
+  curry_free(all);
+
+  // One-shot thunks take the same path, and then free themselves
+  double (*const oneshot)(double, double) =
+      curry_typed(dut_many, 16, 2, many_classes, (int64_t)1, 0.5, (int64_t)2,
+                  1.5, (int64_t)3, 2.5, (int64_t)4, 3.5, (int64_t)5, 4.5,
+                  (int64_t)6, 5.5, (int64_t)7, 6.5, (int64_t)8, 7.5);
+  TEST_ASSERT_NOT_NULL(oneshot);
+  TEST_ASSERT_TRUE(oneshot(8.5, 9.5) == expected);
+}
+
+// Check that one-shot thunks keep the return value in both %rax and %xmm0 when
+// they free themselves
+void test_oneshot(void) {
+  const curry_arg_class_t axpy_classes[] = {D, D, D};
+  const curry_arg_class_t truncate_classes[] = {D, I};
+  curry_stats_t before, after;
+  curry_stats(&before);
+  double (*const axpy)(double, double) =
+      curry_typed(dut_axpy, 1, 2, axpy_classes, 2.0);
+  int64_t (*const truncate)(int64_t) =
+      curry_typed(dut_truncate, 1, 1, truncate_classes, 2.75);
+  TEST_ASSERT_NOT_NULL(axpy);
+  TEST_ASSERT_NOT_NULL(truncate);
+  TEST_ASSERT_TRUE(axpy(3.0, 1.0) == 7.0);
+  TEST_ASSERT_EQUAL(7, truncate(5));
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}
+
+// Check that doubles can be rebound through their bits
+void test_rebind(void) {
+  const uint64_t rebindable = curry_get_option(CURRY_OPTION_REBINDABLE);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_REBINDABLE, 1));
+  const curry_arg_class_t classes[] = {D, D, D};
+  double (*const axpy)(double, double) =
+      curry_typed_persistent(dut_axpy, 1, 2, classes, 2.0);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_REBINDABLE, rebindable));
+  TEST_ASSERT_NOT_NULL(axpy);
+  TEST_ASSERT_TRUE(axpy(3.0, 1.0) == 7.0);
+  const double a = -1.0;
+  uint64_t bits;
+  memcpy(&bits, &a, sizeof(a));
+  TEST_ASSERT_TRUE(curry_rebind(axpy, 0, bits));
+  TEST_ASSERT_TRUE(axpy(3.0, 1.0) == -2.0);
+  curry_free(axpy);
+}
+
+// Check that currying a typed thunk calls it, instead of fusing with it
+void test_nested(void) {
+  const curry_arg_class_t classes[] = {D, D, D};
+  double (*const axpy)(double, double) =
+      curry_typed_persistent(dut_axpy, 1, 2, classes, 2.0);
+  TEST_ASSERT_NOT_NULL(axpy);
+  double (*const nested)(double) =
+      curry_typed_persistent(axpy, 1, 1, classes, 3.0);
+  TEST_ASSERT_NOT_NULL(nested);
+  TEST_ASSERT_TRUE(nested(1.0) == 7.0);
+  curry_free(nested);
+  curry_free(axpy);
+}
+
+// Check that integer-only signatures behave like `vcurry`, and that bad
+// classes are rejected
+void test_classes(void) {
+  const curry_arg_class_t integers[] = {I, I};
+  int64_t (*const truncate)(int64_t) =
+      curry_typed_persistent(dut_truncate, 1, 1, integers, (int64_t)0);
+  TEST_ASSERT_NOT_NULL(truncate);
+  curry_free(truncate);
+
+  const curry_arg_class_t bad[] = {D, (curry_arg_class_t)(F + 1)};
+  TEST_ASSERT_NULL(curry_typed_persistent(dut_truncate, 1, 1, bad, 1.0));
+}
+
+// Check that arguments given as an array are taken as their bits, including
+// when they spill onto the stack
+void test_array(void) {
+  const float one_and_half = 1.5f;
+  uint32_t float_bits;
+  memcpy(&float_bits, &one_and_half, sizeof(one_and_half));
+  const curry_arg_class_t float_classes[] = {F, F, F, F, F, F, F, F, F};
+  uint64_t float_args[8];
+  for (size_t i = 0; i < 8; i++)
+    float_args[i] = float_bits;
+  float (*const floats)(float) = curry_array_typed_persistent(
+      dut_floats, 8, 1, float_classes, float_args);
+  TEST_ASSERT_NOT_NULL(floats);
+  TEST_ASSERT_TRUE(floats(0.5f) == dut_floats(1.5f, 1.5f, 1.5f, 1.5f, 1.5f,
+                                              1.5f, 1.5f, 1.5f, 0.5f));
+  curry_free(floats);
+
+  const double half = 0.5;
+  uint64_t args[3] = {1, 0, 2};
+  memcpy(&args[1], &half, sizeof(half));
+  double (*const mixed)(double) =
+      curry_array_typed(dut_mixed, 3, 1, many_classes, args);
+  TEST_ASSERT_NOT_NULL(mixed);
+  TEST_ASSERT_TRUE(mixed(0.25) == 1 + 1 + 6 + 1);
+
+  const curry_arg_class_t bad[] = {D, (curry_arg_class_t)(F + 1)};
+  TEST_ASSERT_NULL(curry_array_typed_persistent(dut_truncate, 1, 1, bad, args));
+}
@@ -0,0 +1,104 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) { TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_INTERN, 1)); }
+void tearDown(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_INTERN, 0));
+}
+
+static uint64_t dut_add(uint64_t a0, uint64_t a1) { return a0 + a1; }
+static uint64_t dut_sub(uint64_t a0, uint64_t a1) { return a0 - a1; }
+
+// Check that thunks are shared exactly when they'd do the same thing
+void test_identity(void) {
+  void *const t0 = curry_persistent(dut_add, 1, 1, 100);
+  void *const t1 = curry_persistent(dut_add, 1, 1, 100);
+  void *const t2 = curry_persistent(dut_add, 1, 1, 200);
+  void *const t3 = curry_persistent(dut_sub, 1, 1, 100);
+  void *const t4 = curry_persistent(dut_add, 1, 2, 100);
+  TEST_ASSERT_NOT_NULL(t0);
+  TEST_ASSERT_EQUAL_PTR(t0, t1);
+  TEST_ASSERT_NOT_EQUAL(t0, t2);
+  TEST_ASSERT_NOT_EQUAL(t0, t3);
+  TEST_ASSERT_NOT_EQUAL(t0, t4);
+  curry_free(t0);
+  curry_free(t1);
+  curry_free(t2);
+  curry_free(t3);
+  curry_free(t4);
+}
+
+// Check that a shared thunk is only freed once every reference is released
+void test_refcount(void) {
+  curry_stats_t before, during, after;
+  curry_stats(&before);
+  uint64_t (*const t0)(uint64_t) = curry_persistent(dut_add, 1, 1, 100);
+  uint64_t (*const t1)(uint64_t) = curry_persistent(dut_add, 1, 1, 100);
+  TEST_ASSERT_EQUAL_PTR(t0, t1);
+  curry_stats(&during);
+  TEST_ASSERT_EQUAL_UINT64(before.live + 1, during.live);
+
+  curry_free(t0);
+  TEST_ASSERT_EQUAL_UINT64(105, t1(5));
+  curry_stats(&during);
+  TEST_ASSERT_EQUAL_UINT64(before.live + 1, during.live);
+  curry_free(t1);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}
+
+// Check that one-shot thunks and batches behave
+void test_kinds(void) {
+  uint64_t (*const o0)(uint64_t) = curry(dut_add, 1, 1, 100);
+  uint64_t (*const o1)(uint64_t) = curry(dut_add, 1, 1, 100);
+  TEST_ASSERT_NOT_EQUAL(o0, o1);
+  TEST_ASSERT_EQUAL_UINT64(101, o0(1));
+  TEST_ASSERT_EQUAL_UINT64(102, o1(2));
+
+  void *batch[4];
+  TEST_ASSERT_TRUE(curry_batch_persistent(
+      dut_add, 1, 1, (const uint64_t[]){1, 2, 1, 2}, 4, batch));
+  TEST_ASSERT_EQUAL_PTR(batch[0], batch[2]);
+  TEST_ASSERT_EQUAL_PTR(batch[1], batch[3]);
+  TEST_ASSERT_NOT_EQUAL(batch[0], batch[1]);
+  for (size_t i = 0; i < 4; i++)
+    curry_free(batch[i]);
+}
+
+// Check that thunks fused with a shared thunk get shared too
+void test_fused(void) {
+  void *const inner = curry_persistent(dut_add, 1, 1, 100);
+  void *const t0 = curry_persistent(inner, 1, 0, 5);
+  void *const t1 = curry_persistent(dut_add, 2, 0, 100, 5);
+  TEST_ASSERT_EQUAL_PTR(t0, t1);
+  curry_free(inner);
+  TEST_ASSERT_EQUAL_UINT64(105, ((uint64_t(*)(void))t1)());
+  curry_free(t0);
+  curry_free(t1);
+}
+
+static void *make_thunk(void *arg) {
+  (void)arg;
+  return curry_persistent(dut_add, 1, 1, 300);
+}
+
+// Check that threads racing to intern the same thunk all get the same one
+void test_threads(void) {
+  curry_stats_t before, after;
+  curry_stats(&before);
+  pthread_t threads[8];
+  void *thunks[8];
+  for (size_t i = 0; i < 8; i++)
+    TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, make_thunk, NULL));
+  for (size_t i = 0; i < 8; i++)
+    TEST_ASSERT_EQUAL(0, pthread_join(threads[i], &thunks[i]));
+  for (size_t i = 0; i < 8; i++)
+    TEST_ASSERT_EQUAL_PTR(thunks[0], thunks[i]);
+  for (size_t i = 0; i < 8; i++)
+    curry_free(thunks[i]);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}
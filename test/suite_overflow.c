@@ -1,3 +1,4 @@
+#include <stdarg.h>
 #include <stdint.h>
 
 #include "curry.h"
@@ -72,3 +73,44 @@ void test_args16_8_8(void) {
   TEST_ASSERT_EQUAL_UINT64(0xff,
                            curried(0x8, 0x9, 0xa, 0xb, 0xc, 0xd, 0xe, 0xf));
 }
+
+// Takes its argument count first, and checks that the rest of the arguments
+// count up from one in the upper and lower halves
+#define SEQ(i) ((uint64_t)(i) << 32 | (i))
+static uint64_t dut_sequence(uint64_t nargs, ...) {
+  va_list args;
+  va_start(args, nargs);
+  for (uint64_t i = 1; i <= nargs; i++)
+    TEST_ASSERT_EQUAL_UINT64(SEQ(i), va_arg(args, uint64_t));
+  va_end(args);
+  return nargs;
+}
+
+// Check that long runs of now-overflow-args are copied correctly
+void test_args_block_now(void) {
+  uint64_t args[65] = {64};
+  for (uint64_t i = 1; i <= 64; i++)
+    args[i] = SEQ(i);
+  uint64_t (*const oneshot)(void) = curry_array(dut_sequence, 65, 0, args);
+  uint64_t (*const persistent)(void) =
+      curry_array_persistent(dut_sequence, 65, 0, args);
+  TEST_ASSERT_NOT_NULL(oneshot);
+  TEST_ASSERT_NOT_NULL(persistent);
+  TEST_ASSERT_EQUAL_UINT64(64, oneshot());
+  TEST_ASSERT_EQUAL_UINT64(64, persistent());
+  TEST_ASSERT_EQUAL_UINT64(64, persistent());
+  curry_free(persistent);
+}
+
+// Check that long runs of later-overflow-args are copied correctly
+void test_args_block_later(void) {
+  uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                            uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                            uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                            uint64_t) = curry(dut_sequence, 1, 16, 16);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(
+      16, curried(SEQ(1), SEQ(2), SEQ(3), SEQ(4), SEQ(5), SEQ(6), SEQ(7),
+                  SEQ(8), SEQ(9), SEQ(10), SEQ(11), SEQ(12), SEQ(13), SEQ(14),
+                  SEQ(15), SEQ(16)));
+}
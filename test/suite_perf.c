@@ -0,0 +1,120 @@
+// Needed for `dladdr`
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PERF_MAP, 1));
+}
+void tearDown(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PERF_MAP, 0));
+}
+
+static uint64_t dut_identity(uint64_t a0) { return a0; }
+static uint64_t dut_sub(uint64_t a0, uint64_t a1) { return a0 - a1; }
+
+static void map_path(char *path, size_t size) {
+  snprintf(path, size, "/tmp/perf-%ld.map", (long)getpid());
+}
+
+// The name a thunk calling `fn` should have. Library functions often have
+// aliases, so ask for the name the same way the library does.
+static void thunk_name(char *name, size_t size, void *fn, size_t nargs_now,
+                       size_t nargs_later) {
+  Dl_info info;
+  TEST_ASSERT_TRUE(dladdr(fn, &info) != 0 && info.dli_sname != NULL);
+  snprintf(name, size, "curry_thunk<%s,now=%zu,later=%zu>", info.dli_sname,
+           nargs_now, nargs_later);
+}
+
+// Look for an entry in the perf map starting at `code` with the given name. If
+// `code` is `NULL`, the entry can start anywhere.
+static bool find(const void *code, const char *name) {
+  curry_perf_map_flush();
+  char path[64];
+  map_path(path, sizeof(path));
+  FILE *const map = fopen(path, "r");
+  TEST_ASSERT_NOT_NULL(map);
+  bool ret = false;
+  unsigned long start, size;
+  char symbol[512];
+  while (fscanf(map, "%lx %lx %511s", &start, &size, symbol) == 3) {
+    if ((code == NULL || start == (uintptr_t)code) && size != 0 &&
+        strcmp(symbol, name) == 0)
+      ret = true;
+  }
+  fclose(map);
+  return ret;
+}
+
+// Check that thunks are named after the function they call, or its address if
+// it doesn't have a symbol we can find
+void test_names(void) {
+  void *const named = curry_persistent(labs, 1, 0, -5);
+  void *const anonymous = curry_persistent(dut_sub, 1, 1, 5);
+  TEST_ASSERT_NOT_NULL(named);
+  TEST_ASSERT_NOT_NULL(anonymous);
+  char name[128];
+  thunk_name(name, sizeof(name), labs, 1, 0);
+  TEST_ASSERT_TRUE(find(named, name));
+  snprintf(name, sizeof(name), "curry_thunk<%p,now=1,later=1>",
+           (void *)dut_sub);
+  TEST_ASSERT_TRUE(find(anonymous, name));
+  curry_free(named);
+  curry_free(anonymous);
+}
+
+// Check that every thunk in a batch is listed
+void test_batch(void) {
+  const uint64_t args[4] = {1, 2, 3, 4};
+  void *thunks[4];
+  TEST_ASSERT_TRUE(curry_batch_persistent(labs, 1, 0, args, 4, thunks));
+  char name[128];
+  thunk_name(name, sizeof(name), labs, 1, 0);
+  for (size_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(find(thunks[i], name));
+    curry_free(thunks[i]);
+  }
+}
+
+// Check that shared code is listed along with the stubs that jump to it
+void test_shared(void) {
+  const uint64_t shared = curry_get_option(CURRY_OPTION_SHARED_CODE);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_SHARED_CODE, 1));
+  // Nothing else uses this shape, so its code is new
+  void *const stub = curry_persistent(dut_identity, 1, 0, 7);
+  TEST_ASSERT_NOT_NULL(stub);
+  TEST_ASSERT_EQUAL_UINT64(7, ((uint64_t(*)(void))stub)());
+  char name[128];
+  snprintf(name, sizeof(name), "curry_thunk<%p,now=1,later=0>",
+           (void *)dut_identity);
+  TEST_ASSERT_TRUE(find(stub, name));
+  TEST_ASSERT_TRUE(find(NULL, "curry_shape<now=1,later=0,persistent>"));
+  curry_free(stub);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_SHARED_CODE, shared));
+}
+
+// Check that nothing is listed with the option off. This runs last, so it
+// cleans up the map.
+void test_off(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PERF_MAP, 0));
+  // No other test makes thunks of this shape
+  void *const thunk = curry_persistent(labs, 1, 1, 1);
+  TEST_ASSERT_NOT_NULL(thunk);
+  char name[128];
+  thunk_name(name, sizeof(name), labs, 1, 1);
+  TEST_ASSERT_FALSE(find(NULL, name));
+  curry_free(thunk);
+  char path[64];
+  map_path(path, sizeof(path));
+  TEST_ASSERT_EQUAL(0, unlink(path));
+}
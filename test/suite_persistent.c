@@ -0,0 +1,98 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "curry.h"
+#include "unity.h"
+
+static uint64_t dut_add(uint64_t a0, uint64_t a1) { return a0 + a1; }
+
+// Check that a persistent thunk can be called more than once
+void test_many_calls(void) {
+  uint64_t (*const curried)(uint64_t) = curry_persistent(dut_add, 1, 1, 100);
+  TEST_ASSERT_NOT_NULL(curried);
+  for (uint64_t i = 0; i < 1000; i++)
+    TEST_ASSERT_EQUAL_UINT64(100 + i, curried(i));
+  curry_free(curried);
+}
+
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7;
+}
+
+// Check that overflow-args work when called repeatedly
+void test_many_calls_overflow(void) {
+  uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t) =
+      curry_persistent(dut_args8, 4, 4, 1, 2, 3, 4);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(36, curried(5, 6, 7, 8));
+  TEST_ASSERT_EQUAL_UINT64(10, curried(0, 0, 0, 0));
+  curry_free(curried);
+}
+
+static uintptr_t args6_frame;
+static uintptr_t args6_return;
+static uint64_t dut_args6(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5) {
+  args6_frame = (uintptr_t)__builtin_frame_address(0);
+  args6_return = (uintptr_t)__builtin_return_address(0);
+  return a0 << 40 | a1 << 32 | a2 << 24 | a3 << 16 | a4 << 8 | a5;
+}
+
+// Check every way of splitting six register-args. These thunks don't set up a
+// frame, so check that the function still gets an aligned stack, and that it
+// returns straight to the caller instead of to the thunk.
+void test_register_only(void) {
+  const uint64_t args[6] = {1, 2, 3, 4, 5, 6};
+  for (size_t now = 1; now <= 6; now++) {
+    uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                              uint64_t) =
+        curry_array_persistent(dut_args6, now, 6 - now, args);
+    TEST_ASSERT_NOT_NULL(curried);
+    // Pass the rest of the arguments, then zeros for the ones it ignores
+    uint64_t later[6] = {0};
+    memcpy(later, args + now, (6 - now) * sizeof(*args));
+    for (size_t call = 0; call < 2; call++) {
+      TEST_ASSERT_EQUAL_UINT64(UINT64_C(0x010203040506),
+                               curried(later[0], later[1], later[2], later[3],
+                                       later[4], later[5]));
+      TEST_ASSERT_EQUAL_UINT64(0, args6_frame % 16);
+      TEST_ASSERT_TRUE(args6_return < (uintptr_t)curried ||
+                       args6_return >= (uintptr_t)curried + 4096);
+    }
+    curry_free(curried);
+  }
+}
+
+static void *call_many(void *arg) {
+  uint64_t (*const curried)(uint64_t) = (uint64_t(*)(uint64_t))arg;
+  for (uint64_t i = 0; i < 100000; i++) {
+    if (curried(i) != 100 + i)
+      return (void *)1;
+  }
+  return NULL;
+}
+
+// Check that many threads can share a single persistent thunk
+void test_threads(void) {
+  void *curried = curry_persistent(dut_add, 1, 1, 100);
+  TEST_ASSERT_NOT_NULL(curried);
+  pthread_t threads[4];
+  for (size_t i = 0; i < 4; i++)
+    TEST_ASSERT_EQUAL(0, pthread_create(&threads[i], NULL, call_many, curried));
+  for (size_t i = 0; i < 4; i++) {
+    void *res;
+    TEST_ASSERT_EQUAL(0, pthread_join(threads[i], &res));
+    TEST_ASSERT_NULL(res);
+  }
+  curry_free(curried);
+}
+
+// Check that `curry_free` accepts everything `curry` can return
+void test_free_passthrough(void) {
+  TEST_ASSERT_EQUAL_PTR(dut_add, curry_persistent(dut_add, 0, 2));
+  curry_free(curry_persistent(dut_add, 0, 2));
+  curry_free(curry(dut_add, 1, 1, 100));
+  curry_free(NULL);
+}
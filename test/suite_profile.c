@@ -0,0 +1,140 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void tearDown(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PROFILE, CURRY_PROFILE_OFF));
+}
+
+static uint64_t dut_add(uint64_t a0, uint64_t a1) { return a0 + a1; }
+static uint64_t dut_sub(uint64_t a0, uint64_t a1) { return a0 - a1; }
+static uint64_t dut_weigh(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7;
+}
+typedef struct pair_t {
+  uint64_t lo;
+  uint64_t hi;
+} pair_t;
+static pair_t dut_pair(uint64_t a0, uint64_t a1, uint64_t a2) {
+  return (pair_t){a0 + a2, a1 + a2};
+}
+static uint64_t dut_spin(uint64_t a0) {
+  volatile uint64_t x = 0;
+  for (uint64_t i = 0; i < a0; i++)
+    x += i;
+  return x;
+}
+static uint64_t dut_unprofiled(uint64_t a0) { return a0; }
+
+// Find the counters for a function and shape. They're all zero if there aren't
+// any.
+static curry_profile_t find(void *fn, size_t nargs_now, size_t nargs_later) {
+  const size_t count = curry_profile_dump(NULL, 0);
+  curry_profile_t *const entries = calloc(count + 1, sizeof(*entries));
+  TEST_ASSERT_NOT_NULL(entries);
+  TEST_ASSERT_EQUAL(count, curry_profile_dump(entries, count));
+  curry_profile_t ret = {0};
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].fn == fn && entries[i].nargs_now == nargs_now &&
+        entries[i].nargs_later == nargs_later)
+      ret = entries[i];
+  }
+  free(entries);
+  return ret;
+}
+
+// Check that calls are counted by function and shape, whatever kind of thunk
+// makes them
+void test_calls(void) {
+  TEST_ASSERT_FALSE(
+      curry_set_option(CURRY_OPTION_PROFILE, CURRY_PROFILE_CYCLES + 1));
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PROFILE, CURRY_PROFILE_CALLS));
+  uint64_t (*const persistent)(uint64_t) = curry_persistent(dut_add, 1, 1, 1);
+  uint64_t (*const stack)(void) =
+      curry_persistent(dut_weigh, 8, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  TEST_ASSERT_NOT_NULL(persistent);
+  TEST_ASSERT_NOT_NULL(stack);
+  for (uint64_t i = 0; i < 10; i++) {
+    TEST_ASSERT_EQUAL_UINT64(i + 1, persistent(i));
+    uint64_t (*const oneshot)(uint64_t) = curry(dut_add, 1, 1, 2);
+    TEST_ASSERT_EQUAL_UINT64(i + 2, oneshot(i));
+  }
+  TEST_ASSERT_EQUAL_UINT64(36, stack());
+
+  const curry_profile_t add = find(dut_add, 1, 1);
+  TEST_ASSERT_EQUAL_PTR(dut_add, add.fn);
+  TEST_ASSERT_EQUAL_UINT64(20, add.calls);
+  TEST_ASSERT_EQUAL_UINT64(0, add.cycles);
+  TEST_ASSERT_EQUAL_UINT64(1, find(dut_weigh, 8, 0).calls);
+  curry_free(persistent);
+  curry_free(stack);
+}
+
+// Check that thunks with different shapes get different counters, and that
+// fused thunks count under the function they actually call
+void test_shapes(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_PROFILE, CURRY_PROFILE_CALLS));
+  uint64_t (*const one)(uint64_t) = curry_persistent(dut_sub, 1, 1, 5);
+  uint64_t (*const two)(void) = curry_persistent(dut_sub, 2, 0, 5, 1);
+  uint64_t (*const fused)(void) = curry_persistent(one, 1, 0, 2);
+  TEST_ASSERT_NOT_NULL(one);
+  TEST_ASSERT_NOT_NULL(two);
+  TEST_ASSERT_NOT_NULL(fused);
+  TEST_ASSERT_EQUAL_UINT64(4, one(1));
+  TEST_ASSERT_EQUAL_UINT64(4, two());
+  TEST_ASSERT_EQUAL_UINT64(3, fused());
+  TEST_ASSERT_EQUAL_UINT64(3, fused());
+  TEST_ASSERT_EQUAL_UINT64(1, find(dut_sub, 1, 1).calls);
+  TEST_ASSERT_EQUAL_UINT64(3, find(dut_sub, 2, 0).calls);
+
+  curry_profile_reset();
+  TEST_ASSERT_EQUAL_UINT64(0, find(dut_sub, 2, 0).calls);
+  TEST_ASSERT_EQUAL_UINT64(4, two());
+  TEST_ASSERT_EQUAL_UINT64(1, find(dut_sub, 2, 0).calls);
+  curry_free(one);
+  curry_free(two);
+  curry_free(fused);
+}
+
+// Check that cycles are counted, and that timing doesn't disturb arguments or
+// return values in any of the registers it uses
+void test_cycles(void) {
+  TEST_ASSERT_TRUE(
+      curry_set_option(CURRY_OPTION_PROFILE, CURRY_PROFILE_CYCLES));
+  uint64_t (*const spin)(uint64_t) = curry_persistent(dut_spin, 0, 1);
+  pair_t (*const pair)(uint64_t, uint64_t) =
+      curry_persistent(dut_pair, 1, 2, 1);
+  pair_t (*const oneshot)(uint64_t, uint64_t) = curry(dut_pair, 1, 2, 2);
+  TEST_ASSERT_EQUAL_PTR(dut_spin, spin);
+  TEST_ASSERT_NOT_NULL(pair);
+  TEST_ASSERT_NOT_NULL(oneshot);
+
+  uint64_t (*const timed)(void) = curry_persistent(dut_spin, 1, 0, 100000);
+  TEST_ASSERT_NOT_NULL(timed);
+  timed();
+  const curry_profile_t spun = find(dut_spin, 1, 0);
+  TEST_ASSERT_EQUAL_UINT64(1, spun.calls);
+  TEST_ASSERT_GREATER_THAN_UINT64(100000, spun.cycles);
+
+  const pair_t p = pair(10, 20);
+  TEST_ASSERT_EQUAL_UINT64(1 + 20, p.lo);
+  TEST_ASSERT_EQUAL_UINT64(10 + 20, p.hi);
+  // One-shot thunks only keep %rax when they free themselves
+  TEST_ASSERT_EQUAL_UINT64(2 + 20, oneshot(10, 20).lo);
+  TEST_ASSERT_EQUAL_UINT64(2, find(dut_pair, 1, 2).calls);
+  curry_free(timed);
+  curry_free(pair);
+}
+
+// Check that thunks created with profiling off aren't counted
+void test_off(void) {
+  uint64_t (*const curried)(void) = curry_persistent(dut_unprofiled, 1, 0, 1);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(1, curried());
+  TEST_ASSERT_NULL(find(dut_unprofiled, 1, 0).fn);
+  curry_free(curried);
+}
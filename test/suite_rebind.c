@@ -0,0 +1,134 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_REBINDABLE, 1));
+}
+void tearDown(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_REBINDABLE, 0));
+}
+
+static uint64_t dut_identity(uint64_t a0) { return a0; }
+static uint64_t dut_sub(uint64_t a0, uint64_t a1) { return a0 - a1; }
+static uint64_t dut_weigh(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7,
+                          uint64_t a8, uint64_t a9, uint64_t a10,
+                          uint64_t a11) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7 +
+         9 * a8 + 10 * a9 + 11 * a10 + 12 * a11;
+}
+
+// Check that arguments passed in registers can be changed, whatever values
+// they're changed between
+void test_registers(void) {
+  uint64_t (*const curried)(uint64_t) = curry_persistent(dut_sub, 1, 1, 100);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(99, curried(1));
+  TEST_ASSERT_TRUE(curry_rebind(curried, 0, 0));
+  TEST_ASSERT_EQUAL_UINT64(UINT64_MAX, curried(1));
+  TEST_ASSERT_TRUE(curry_rebind(curried, 0, UINT64_C(0x123456789abcdef0)));
+  TEST_ASSERT_EQUAL_UINT64(UINT64_C(0x123456789abcdeef), curried(1));
+  TEST_ASSERT_FALSE(curry_rebind(curried, 1, 0));
+  curry_free(curried);
+}
+
+// Check that arguments passed on the stack can be changed too, both with and
+// without later-args
+void test_stack(void) {
+  uint64_t (*const all)(void) = curry_persistent(
+      dut_weigh, 12, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+  uint64_t (*const some)(uint64_t, uint64_t) =
+      curry_persistent(dut_weigh, 10, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1);
+  TEST_ASSERT_NOT_NULL(all);
+  TEST_ASSERT_NOT_NULL(some);
+  TEST_ASSERT_EQUAL_UINT64(78, all());
+  TEST_ASSERT_EQUAL_UINT64(78, some(1, 1));
+
+  TEST_ASSERT_TRUE(curry_rebind(all, 0, 2));
+  TEST_ASSERT_TRUE(curry_rebind(all, 11, 2));
+  TEST_ASSERT_EQUAL_UINT64(78 + 1 + 12, all());
+  TEST_ASSERT_TRUE(curry_rebind(some, 9, 2));
+  TEST_ASSERT_EQUAL_UINT64(78 + 10, some(1, 1));
+  TEST_ASSERT_FALSE(curry_rebind(some, 10, 2));
+  curry_free(all);
+  curry_free(some);
+}
+
+// Check that only rebindable thunks can be rebound
+void test_not_rebindable(void) {
+  void *const oneshot = curry(dut_identity, 1, 0, 1);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_REBINDABLE, 0));
+  void *const fixed = curry_persistent(dut_identity, 1, 0, 1);
+  TEST_ASSERT_NOT_NULL(oneshot);
+  TEST_ASSERT_NOT_NULL(fixed);
+  TEST_ASSERT_FALSE(curry_rebind(oneshot, 0, 2));
+  TEST_ASSERT_FALSE(curry_rebind(fixed, 0, 2));
+  TEST_ASSERT_FALSE(curry_rebind(dut_identity, 0, 2));
+  TEST_ASSERT_FALSE(curry_rebind(NULL, 0, 2));
+  curry_free(oneshot);
+  curry_free(fixed);
+}
+
+// Check that rebindable thunks aren't shared, since rebinding one would change
+// the other
+void test_not_interned(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_INTERN, 1));
+  uint64_t (*const t0)(void) = curry_persistent(dut_identity, 1, 0, 1);
+  uint64_t (*const t1)(void) = curry_persistent(dut_identity, 1, 0, 1);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_INTERN, 0));
+  TEST_ASSERT_NOT_NULL(t0);
+  TEST_ASSERT_NOT_EQUAL(t0, t1);
+  TEST_ASSERT_TRUE(curry_rebind(t0, 0, 2));
+  TEST_ASSERT_EQUAL_UINT64(2, t0());
+  TEST_ASSERT_EQUAL_UINT64(1, t1());
+  curry_free(t0);
+  curry_free(t1);
+}
+
+// Check that currying a rebindable thunk doesn't copy its arguments, so the new
+// thunk sees when they change
+void test_curried(void) {
+  void *const inner = curry_persistent(dut_sub, 1, 1, 100);
+  TEST_ASSERT_NOT_NULL(inner);
+  uint64_t (*const outer)(void) = curry_persistent(inner, 1, 0, 1);
+  TEST_ASSERT_NOT_NULL(outer);
+  TEST_ASSERT_EQUAL_UINT64(99, outer());
+  TEST_ASSERT_TRUE(curry_rebind(inner, 0, 200));
+  TEST_ASSERT_EQUAL_UINT64(199, outer());
+  curry_free(outer);
+  curry_free(inner);
+}
+
+// The two halves of every value we bind match, so a torn read would show up as
+// a value whose halves don't
+#define HALVES(i) ((uint64_t)(i) << 32 | (i))
+#define REBINDS (100000)
+static void *call_until_done(void *arg) {
+  uint64_t (*const curried)(void) = arg;
+  bool torn = false;
+  uint64_t last = 0;
+  while (last != HALVES(REBINDS)) {
+    last = curried();
+    torn |= (last >> 32) != (last & UINT32_MAX);
+  }
+  return torn ? arg : NULL;
+}
+
+// Check that calls running while the thunk is rebound see whole values
+void test_concurrent(void) {
+  void *const curried = curry_persistent(dut_identity, 1, 0, HALVES(0));
+  TEST_ASSERT_NOT_NULL(curried);
+  pthread_t thread;
+  TEST_ASSERT_EQUAL(0,
+                    pthread_create(&thread, NULL, call_until_done, curried));
+  for (uint64_t i = 1; i <= REBINDS; i++)
+    TEST_ASSERT_TRUE(curry_rebind(curried, 0, HALVES(i)));
+  void *torn;
+  TEST_ASSERT_EQUAL(0, pthread_join(thread, &torn));
+  TEST_ASSERT_NULL(torn);
+  curry_free(curried);
+}
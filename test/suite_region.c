@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint64_t dut_add(uint64_t a, uint64_t b) { return a + b; }
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  return a0 + 2 * a1 + 3 * a2 + 4 * a3 + 5 * a4 + 6 * a5 + 7 * a6 + 8 * a7;
+}
+
+// Check that thunks in a region work until it's destroyed, and that they're
+// counted as freed when it is
+void test_region(void) {
+  enum { NTHUNKS = 5000 };
+  static uint64_t (*thunks[NTHUNKS])(uint64_t);
+  curry_stats_t before, during, after;
+  curry_stats(&before);
+  curry_region_t *const region = curry_region_create();
+  TEST_ASSERT_NOT_NULL(region);
+  for (size_t i = 0; i < NTHUNKS; i++) {
+    thunks[i] = curry_in_region(region, dut_add, 1, 1, i);
+    TEST_ASSERT_NOT_NULL(thunks[i]);
+  }
+  for (size_t i = 0; i < NTHUNKS; i++) {
+    TEST_ASSERT_EQUAL_UINT64(i + 1, thunks[i](1));
+    TEST_ASSERT_EQUAL_UINT64(i + 2, thunks[i](2));
+  }
+  curry_stats(&during);
+  TEST_ASSERT_EQUAL_UINT64(before.live + NTHUNKS, during.live);
+  curry_region_destroy(region);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+  TEST_ASSERT_EQUAL_UINT64(before.bytes_used, after.bytes_used);
+  TEST_ASSERT_EQUAL_UINT64(during.freed + NTHUNKS, after.freed);
+  curry_region_destroy(NULL);
+}
+
+// Check that thunks are packed more tightly than slots, and that they can use
+// the stack
+void test_packing(void) {
+  curry_region_t *const region = curry_region_create();
+  TEST_ASSERT_NOT_NULL(region);
+  // These would each take up 128 bytes in a slot
+  const uint8_t *const first = curry_in_region(region, dut_add, 2, 0, 1, 2);
+  const uint8_t *const second = curry_in_region(region, dut_add, 2, 0, 3, 4);
+  TEST_ASSERT_NOT_NULL(first);
+  TEST_ASSERT_NOT_NULL(second);
+  TEST_ASSERT_TRUE(second > first && second - first < 128);
+  TEST_ASSERT_EQUAL_UINT64(3, ((uint64_t(*)(void))first)());
+  TEST_ASSERT_EQUAL_UINT64(7, ((uint64_t(*)(void))second)());
+  TEST_ASSERT_EQUAL_UINT64(0, (uintptr_t)second % 16);
+
+  uint64_t (*const one)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                        uint64_t, uint64_t) =
+      curry_in_region(region, dut_args8, 1, 7, 1);
+  uint64_t (*const all)(void) =
+      curry_in_region(region, dut_args8, 8, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  TEST_ASSERT_NOT_NULL(one);
+  TEST_ASSERT_NOT_NULL(all);
+  TEST_ASSERT_EQUAL_UINT64(36, one(1, 1, 1, 1, 1, 1, 1));
+  TEST_ASSERT_EQUAL_UINT64(36, all());
+  curry_region_destroy(region);
+}
+
+// Check that region thunks are left alone by `curry_free`, and that currying
+// them again calls them
+void test_foreign(void) {
+  curry_region_t *const region = curry_region_create();
+  TEST_ASSERT_NOT_NULL(region);
+  uint64_t (*const add)(uint64_t) = curry_in_region(region, dut_add, 1, 1, 40);
+  TEST_ASSERT_NOT_NULL(add);
+  curry_free(add);
+  TEST_ASSERT_EQUAL_UINT64(42, add(2));
+  uint64_t (*const nested)(void) = curry_persistent(add, 1, 0, 2);
+  TEST_ASSERT_NOT_NULL(nested);
+  TEST_ASSERT_EQUAL_UINT64(42, nested());
+  curry_free(nested);
+
+  // Fusing with a thunk from the slab still works
+  void *const inner = curry_persistent(dut_add, 1, 1, 40);
+  TEST_ASSERT_NOT_NULL(inner);
+  uint64_t (*const fused)(void) = curry_in_region(region, inner, 1, 0, 2);
+  curry_free(inner);
+  TEST_ASSERT_NOT_NULL(fused);
+  TEST_ASSERT_EQUAL_UINT64(42, fused());
+  curry_region_destroy(region);
+}
+
+// Check that memory from a destroyed region is used again
+void test_reuse(void) {
+  curry_stats_t first, second;
+  for (int i = 0; i < 2; i++) {
+    curry_region_t *const region = curry_region_create();
+    TEST_ASSERT_NOT_NULL(region);
+    TEST_ASSERT_NOT_NULL(curry_in_region(region, dut_add, 1, 1, 1));
+    curry_stats(i == 0 ? &first : &second);
+    curry_region_destroy(region);
+  }
+  TEST_ASSERT_EQUAL_UINT64(first.bytes_mapped, second.bytes_mapped);
+  TEST_ASSERT_NULL(
+      curry_in_region(NULL, dut_add, CURRY_MAX_ARGS, 1, (uint64_t)0));
+}
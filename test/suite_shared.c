@@ -0,0 +1,93 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "curry.h"
+#include "unity.h"
+
+void setUp(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_SHARED_CODE, 1));
+}
+void tearDown(void) {
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_SHARED_CODE, 0));
+}
+
+static uint64_t dut_args8(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7) {
+  TEST_ASSERT_EQUAL_UINT64(a0, 0x0);
+  TEST_ASSERT_EQUAL_UINT64(a1, 0x1);
+  TEST_ASSERT_EQUAL_UINT64(a2, 0x2);
+  TEST_ASSERT_EQUAL_UINT64(a3, 0x3);
+  TEST_ASSERT_EQUAL_UINT64(a4, 0x4);
+  TEST_ASSERT_EQUAL_UINT64(a5, 0x5);
+  TEST_ASSERT_EQUAL_UINT64(a6, 0x6);
+  TEST_ASSERT_EQUAL_UINT64(a7, 0x7);
+  return 0xff;
+}
+
+// Check that one-shot thunks work with shared code, including with both kinds
+// of overflow
+void test_args8_4_4(void) {
+  uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t) =
+      curry(dut_args8, 4, 4, 0x0, 0x1, 0x2, 0x3);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(0xff, curried(0x4, 0x5, 0x6, 0x7));
+}
+void test_args8_7_1(void) {
+  uint64_t (*const curried)(uint64_t) =
+      curry(dut_args8, 7, 1, 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(0xff, curried(0x7));
+}
+void test_args8_1_7(void) {
+  uint64_t (*const curried)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                            uint64_t, uint64_t) = curry(dut_args8, 1, 7, 0x0);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(0xff, curried(0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7));
+}
+
+// Check that persistent thunks work with shared code, and that two thunks of
+// the same shape have exactly the same code
+static uint64_t dut_add(uint64_t a0, uint64_t a1) { return a0 + a1; }
+void test_persistent(void) {
+  uint64_t (*const curried0)(uint64_t) = curry_persistent(dut_add, 1, 1, 100);
+  uint64_t (*const curried1)(uint64_t) = curry_persistent(dut_add, 1, 1, 200);
+  TEST_ASSERT_NOT_NULL(curried0);
+  TEST_ASSERT_NOT_NULL(curried1);
+  TEST_ASSERT_EQUAL_MEMORY((const void *)curried0, (const void *)curried1, 16);
+  for (uint64_t i = 0; i < 10; i++) {
+    TEST_ASSERT_EQUAL_UINT64(100 + i, curried0(i));
+    TEST_ASSERT_EQUAL_UINT64(200 + i, curried1(i));
+  }
+  curry_free(curried0);
+  curry_free(curried1);
+}
+
+// Check that shared code copies long runs of overflow-args correctly
+#define SEQ(i) ((uint64_t)(i) << 32 | (i))
+static uint64_t dut_sequence(uint64_t nargs, ...) {
+  va_list args;
+  va_start(args, nargs);
+  for (uint64_t i = 1; i <= nargs; i++)
+    TEST_ASSERT_EQUAL_UINT64(SEQ(i), va_arg(args, uint64_t));
+  va_end(args);
+  return nargs;
+}
+void test_args_block(void) {
+  uint64_t args[17] = {16};
+  for (uint64_t i = 1; i <= 16; i++)
+    args[i] = SEQ(i);
+  uint64_t (*const now)(void) = curry_array(dut_sequence, 17, 0, args);
+  TEST_ASSERT_NOT_NULL(now);
+  TEST_ASSERT_EQUAL_UINT64(16, now());
+
+  uint64_t (*const later)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                          uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                          uint64_t, uint64_t, uint64_t, uint64_t, uint64_t,
+                          uint64_t) = curry(dut_sequence, 1, 16, 16);
+  TEST_ASSERT_NOT_NULL(later);
+  TEST_ASSERT_EQUAL_UINT64(
+      16, later(SEQ(1), SEQ(2), SEQ(3), SEQ(4), SEQ(5), SEQ(6), SEQ(7), SEQ(8),
+                SEQ(9), SEQ(10), SEQ(11), SEQ(12), SEQ(13), SEQ(14), SEQ(15),
+                SEQ(16)));
+}
@@ -43,6 +43,52 @@ void test_reg_general(void) {
   TEST_ASSERT_EQUAL_UINT64(0xff, curried());
 }
 
+// For zero and all-ones, which have their own encodings. Each argument must be
+// one or the other, and the result says which ones were all-ones.
+static uint64_t dut_reg_special(uint64_t a0, uint64_t a1, uint64_t a2,
+                                uint64_t a3, uint64_t a4, uint64_t a5) {
+  const uint64_t args[6] = {a0, a1, a2, a3, a4, a5};
+  uint64_t ret = 0;
+  for (size_t i = 0; i < 6; i++) {
+    TEST_ASSERT_TRUE(args[i] == 0 || args[i] == UINT64_MAX);
+    ret |= (args[i] & 1) << i;
+  }
+  return ret;
+}
+void test_reg_special(void) {
+  // Registers %r8 and %r9 need different prefixes, so make sure both values
+  // land in both of them
+  uint64_t (*const curried0)(void) =
+      curry(dut_reg_special, 6, 0, UINT64_C(0), UINT64_MAX, UINT64_C(0),
+            UINT64_MAX, UINT64_C(0), UINT64_MAX);
+  TEST_ASSERT_NOT_NULL(curried0);
+  TEST_ASSERT_EQUAL_UINT64(0x2a, curried0());
+  uint64_t (*const curried1)(void) =
+      curry(dut_reg_special, 6, 0, UINT64_MAX, UINT64_C(0), UINT64_MAX,
+            UINT64_C(0), UINT64_MAX, UINT64_C(0));
+  TEST_ASSERT_NOT_NULL(curried1);
+  TEST_ASSERT_EQUAL_UINT64(0x15, curried1());
+}
+
+// For every kind of value, when it has to go on the stack
+static uint64_t dut_stack(uint64_t a0, uint64_t a1, uint64_t a2, uint64_t a3,
+                          uint64_t a4, uint64_t a5, uint64_t a6, uint64_t a7,
+                          uint64_t a8, uint64_t a9) {
+  TEST_ASSERT_EQUAL_UINT64(0, a6);
+  TEST_ASSERT_EQUAL_UINT64(UINT64_C(0xffff1234), a7);
+  TEST_ASSERT_EQUAL_UINT64(UINT64_C(0xffffffff80000000), a8);
+  TEST_ASSERT_EQUAL_UINT64(UINT64_C(0x0123456789abcdef), a9);
+  return a0 + a1 + a2 + a3 + a4 + a5;
+}
+void test_stack(void) {
+  uint64_t (*const curried)(void) =
+      curry(dut_stack, 10, 0, 1, 2, 3, 4, 5, 6, UINT64_C(0),
+            UINT64_C(0xffff1234), UINT64_C(0xffffffff80000000),
+            UINT64_C(0x0123456789abcdef));
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(21, curried());
+}
+
 // -----------------------------------------------------------------------------
 // Check that currying works even with an obscene number of arguments
 
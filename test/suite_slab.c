@@ -0,0 +1,211 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "curry.h"
+#include "unity.h"
+
+static uint64_t dut_identity(uint64_t a0) { return a0; }
+
+// Check that we can have more thunks live at once than the kernel would let us
+// have mappings
+void test_many_live(void) {
+  const size_t n = 100000;
+  uint64_t (**const curried)(void) = calloc(n, sizeof(*curried));
+  TEST_ASSERT_NOT_NULL(curried);
+  for (size_t i = 0; i < n; i++) {
+    curried[i] = curry(dut_identity, 1, 0, i);
+    TEST_ASSERT_NOT_NULL(curried[i]);
+  }
+  for (size_t i = 0; i < n; i++)
+    TEST_ASSERT_EQUAL_UINT64(i, curried[i]());
+  free(curried);
+}
+
+// Check that thunks are packed on cache lines
+void test_alignment(void) {
+  void *curried = curry(dut_identity, 1, 0, 0xaa);
+  TEST_ASSERT_NOT_NULL(curried);
+  TEST_ASSERT_EQUAL_UINT64(0, (uintptr_t)curried % 64);
+  TEST_ASSERT_EQUAL_UINT64(0xaa, ((uint64_t(*)(void))curried)());
+}
+
+// Check that small thunks take up a single cache line, including their record
+void test_compact(void) {
+  curry_stats_t before, after;
+  curry_stats(&before);
+  void *curried = curry_persistent(dut_identity, 1, 0, 0xaa);
+  TEST_ASSERT_NOT_NULL(curried);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.sizes[0] + 1, after.sizes[0]);
+  TEST_ASSERT_EQUAL_UINT64(0xaa, ((uint64_t(*)(void))curried)());
+  curry_free(curried);
+}
+
+// Check that a thunk's slot is reused once it's freed itself
+void test_reuse(void) {
+  void *curried0 = curry(dut_identity, 1, 0, 0xaa);
+  TEST_ASSERT_NOT_NULL(curried0);
+  TEST_ASSERT_EQUAL_UINT64(0xaa, ((uint64_t(*)(void))curried0)());
+  void *curried1 = curry(dut_identity, 1, 0, 0xbb);
+  TEST_ASSERT_NOT_NULL(curried1);
+  TEST_ASSERT_EQUAL_PTR(curried0, curried1);
+  TEST_ASSERT_EQUAL_UINT64(0xbb, ((uint64_t(*)(void))curried1)());
+}
+
+// Check that no page is ever both writable and executable, even right after a
+// thunk is created
+void test_wx(void) {
+  void *curried = curry(dut_identity, 1, 0, 0xaa);
+  TEST_ASSERT_NOT_NULL(curried);
+  FILE *maps = fopen("/proc/self/maps", "r");
+  TEST_ASSERT_NOT_NULL(maps);
+  char line[512];
+  while (fgets(line, sizeof(line), maps) != NULL) {
+    char perms[5];
+    TEST_ASSERT_EQUAL(1, sscanf(line, "%*x-%*x %4s", perms));
+    TEST_ASSERT_FALSE(perms[1] == 'w' && perms[2] == 'x');
+  }
+  fclose(maps);
+  TEST_ASSERT_EQUAL_UINT64(0xaa, ((uint64_t(*)(void))curried)());
+}
+
+static void *free_all(void *arg) {
+  void **const curried = arg;
+  for (size_t i = 0; curried[i] != NULL; i++)
+    curry_free(curried[i]);
+  return NULL;
+}
+
+// Check that thunks can be freed by a different thread than the one that made
+// them, and that their slots can be reused afterwards
+void test_cross_thread(void) {
+  const size_t n = 10000;
+  for (size_t round = 0; round < 4; round++) {
+    void **const curried = calloc(n + 1, sizeof(*curried));
+    TEST_ASSERT_NOT_NULL(curried);
+    for (size_t i = 0; i < n; i++) {
+      curried[i] = curry_persistent(dut_identity, 1, 0, i);
+      TEST_ASSERT_NOT_NULL(curried[i]);
+    }
+    for (size_t i = 0; i < n; i++)
+      TEST_ASSERT_EQUAL_UINT64(i, ((uint64_t(*)(void))curried[i])());
+    pthread_t thread;
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, free_all, curried));
+    TEST_ASSERT_EQUAL(0, pthread_join(thread, NULL));
+    free(curried);
+  }
+}
+
+// Check that memory freed by thunks isn't given back to the system when they're
+// freed, no matter how much of it there is, but that it is once more thunks are
+// created
+void test_deferred_reclaim(void) {
+  const uint64_t cache = curry_get_option(CURRY_OPTION_THREAD_CACHE);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_THREAD_CACHE, 0));
+  // These thunks are never called. Binding lots of arguments just puts them in
+  // a size class that no other test uses, and fills over a dozen chunks.
+  uint64_t args[40] = {0};
+  const size_t n = 2000;
+  void **const curried = calloc(n, sizeof(*curried));
+  TEST_ASSERT_NOT_NULL(curried);
+  for (size_t i = 0; i < n; i++) {
+    args[0] = i;
+    curried[i] = curry_array_persistent(dut_identity, 40, 0, args);
+    TEST_ASSERT_NOT_NULL(curried[i]);
+  }
+
+  curry_stats_t live, freed, after;
+  curry_stats(&live);
+  for (size_t i = 0; i < n; i++)
+    curry_free(curried[i]);
+  curry_stats(&freed);
+  TEST_ASSERT_EQUAL_UINT64(live.bytes_mapped, freed.bytes_mapped);
+  args[0] = n;
+  void *const next = curry_array_persistent(dut_identity, 40, 0, args);
+  TEST_ASSERT_NOT_NULL(next);
+  curry_stats(&after);
+  TEST_ASSERT_GREATER_THAN_UINT64(after.bytes_mapped, freed.bytes_mapped);
+
+  curry_free(next);
+  free(curried);
+  TEST_ASSERT_TRUE(curry_set_option(CURRY_OPTION_THREAD_CACHE, cache));
+}
+
+// Create enough thunks that new memory has to be mapped for them
+#define ARENA_THUNKS (80000)
+static void **make_arena_thunks(void) {
+  void **const curried = calloc(ARENA_THUNKS, sizeof(*curried));
+  TEST_ASSERT_NOT_NULL(curried);
+  for (size_t i = 0; i < ARENA_THUNKS; i++) {
+    curried[i] = curry_persistent(dut_identity, 1, 0, i);
+    TEST_ASSERT_NOT_NULL(curried[i]);
+  }
+  for (size_t i = 0; i < ARENA_THUNKS; i++)
+    TEST_ASSERT_EQUAL_UINT64(i, ((uint64_t(*)(void))curried[i])());
+  return curried;
+}
+static void free_arena_thunks(void **curried) {
+  for (size_t i = 0; i < ARENA_THUNKS; i++)
+    curry_free(curried[i]);
+  free(curried);
+}
+
+// Check that asking for huge pages works whether or not the system has any, and
+// that the kind of pages we got is reported
+void test_huge_pages(void) {
+  TEST_ASSERT_FALSE(
+      curry_set_option(CURRY_OPTION_HUGE_PAGES, CURRY_PAGES_HUGETLB + 1));
+  TEST_ASSERT_TRUE(
+      curry_set_option(CURRY_OPTION_HUGE_PAGES, CURRY_PAGES_HUGETLB));
+  void **const huge = make_arena_thunks();
+  const curry_page_mode_t mode = curry_page_mode();
+  TEST_ASSERT_TRUE(mode == CURRY_PAGES_SMALL ||
+                   mode == CURRY_PAGES_TRANSPARENT ||
+                   mode == CURRY_PAGES_HUGETLB);
+
+  TEST_ASSERT_TRUE(
+      curry_set_option(CURRY_OPTION_HUGE_PAGES, CURRY_PAGES_SMALL));
+  void **const small = make_arena_thunks();
+  TEST_ASSERT_EQUAL(CURRY_PAGES_SMALL, curry_page_mode());
+  free_arena_thunks(huge);
+  free_arena_thunks(small);
+}
+
+// Check that reserved memory is mapped up front and kept while unused, and that
+// trimming gives it back
+void test_reserve_trim(void) {
+  TEST_ASSERT_FALSE(curry_reserve(1, CURRY_MAX_ARGS + 1));
+  // Start from nothing unused, so none of it gets reclaimed along the way
+  curry_trim();
+  curry_stats_t before, reserved, live, freed, trimmed;
+  curry_stats(&before);
+  const size_t n = 300;
+  TEST_ASSERT_TRUE(curry_reserve(n, 40));
+  curry_stats(&reserved);
+  TEST_ASSERT_GREATER_THAN_UINT64(before.bytes_mapped, reserved.bytes_mapped);
+
+  uint64_t args[40] = {0};
+  void **const curried = calloc(n, sizeof(*curried));
+  TEST_ASSERT_NOT_NULL(curried);
+  for (size_t i = 0; i < n; i++) {
+    args[0] = i;
+    curried[i] = curry_array_persistent(dut_identity, 40, 0, args);
+    TEST_ASSERT_NOT_NULL(curried[i]);
+  }
+  curry_stats(&live);
+  TEST_ASSERT_EQUAL_UINT64(reserved.bytes_mapped, live.bytes_mapped);
+  for (size_t i = 0; i < n; i++) {
+    TEST_ASSERT_EQUAL_UINT64(i, ((uint64_t(*)(void))curried[i])());
+    curry_free(curried[i]);
+  }
+  curry_stats(&freed);
+  TEST_ASSERT_EQUAL_UINT64(reserved.bytes_mapped, freed.bytes_mapped);
+
+  curry_trim();
+  curry_stats(&trimmed);
+  TEST_ASSERT_GREATER_THAN_UINT64(trimmed.bytes_mapped, reserved.bytes_mapped);
+  free(curried);
+}
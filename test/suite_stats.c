@@ -0,0 +1,128 @@
+#include <pthread.h>
+#include <stdint.h>
+
+#include "curry.h"
+#include "unity.h"
+
+static uint64_t dut_identity(uint64_t a0) { return a0; }
+static uint64_t dut_add(uint64_t a0, uint64_t a1) { return a0 + a1; }
+
+// Check that creating and freeing thunks is counted, however they're freed
+void test_counts(void) {
+  curry_stats_t before, during, after;
+  curry_stats(&before);
+
+  uint64_t (*const oneshot)(void) = curry(dut_identity, 1, 0, 0xaa);
+  uint64_t (*const persistent)(void) = curry_persistent(dut_identity, 1, 0, 0);
+  TEST_ASSERT_NOT_NULL(oneshot);
+  TEST_ASSERT_NOT_NULL(persistent);
+  curry_stats(&during);
+  TEST_ASSERT_EQUAL_UINT64(before.created + 2, during.created);
+  TEST_ASSERT_EQUAL_UINT64(before.live + 2, during.live);
+  TEST_ASSERT_GREATER_THAN_UINT64(before.bytes_used, during.bytes_used);
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT64(during.bytes_used, during.bytes_mapped);
+
+  TEST_ASSERT_EQUAL_UINT64(0xaa, oneshot());
+  curry_free(persistent);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.freed + 2, after.freed);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+  TEST_ASSERT_EQUAL_UINT64(before.bytes_used, after.bytes_used);
+}
+
+// Check that currying a one-shot thunk doesn't leak it, whether or not the new
+// thunk is one-shot too
+void test_fused(void) {
+  curry_stats_t before, after;
+  curry_stats(&before);
+
+  uint64_t (*const inner)(uint64_t) = curry(dut_add, 1, 1, 2);
+  TEST_ASSERT_NOT_NULL(inner);
+  uint64_t (*const persistent)(void) = curry_persistent(inner, 1, 0, 3);
+  TEST_ASSERT_NOT_NULL(persistent);
+  TEST_ASSERT_EQUAL_UINT64(5, persistent());
+  curry_free(persistent);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+
+  uint64_t (*const oneshot_inner)(uint64_t) = curry(dut_add, 1, 1, 4);
+  TEST_ASSERT_NOT_NULL(oneshot_inner);
+  uint64_t (*const oneshot)(void) = curry(oneshot_inner, 1, 0, 5);
+  TEST_ASSERT_NOT_NULL(oneshot);
+  TEST_ASSERT_EQUAL_UINT64(9, oneshot());
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}
+
+// Check that every thunk lands in exactly one bucket, and that bigger thunks
+// land in higher buckets
+void test_sizes(void) {
+  curry_stats_t before, small, large;
+  curry_stats(&before);
+
+  void *const t0 = curry_persistent(dut_identity, 1, 0, 0);
+  TEST_ASSERT_NOT_NULL(t0);
+  curry_stats(&small);
+  uint64_t (*const t1)(void) = curry_array_persistent(
+      dut_identity, 64, 0, (const uint64_t[64]){0});
+  TEST_ASSERT_NOT_NULL(t1);
+  curry_stats(&large);
+
+  size_t small_bucket = CURRY_STATS_SIZE_BUCKETS;
+  size_t large_bucket = CURRY_STATS_SIZE_BUCKETS;
+  for (size_t i = 0; i < CURRY_STATS_SIZE_BUCKETS; i++) {
+    if (small.sizes[i] != before.sizes[i]) {
+      TEST_ASSERT_EQUAL_UINT64(before.sizes[i] + 1, small.sizes[i]);
+      small_bucket = i;
+    }
+    if (large.sizes[i] != small.sizes[i]) {
+      TEST_ASSERT_EQUAL_UINT64(small.sizes[i] + 1, large.sizes[i]);
+      large_bucket = i;
+    }
+  }
+  TEST_ASSERT_LESS_THAN(CURRY_STATS_SIZE_BUCKETS, large_bucket);
+  TEST_ASSERT_LESS_THAN(large_bucket, small_bucket);
+
+  curry_free(t0);
+  curry_free(t1);
+}
+
+// Check that failures are counted by reason
+void test_failures(void) {
+  curry_stats_t before, after;
+  curry_stats(&before);
+  TEST_ASSERT_NULL(curry(dut_identity, CURRY_MAX_ARGS, 1));
+  TEST_ASSERT_NULL(curry_array(dut_identity, 1, CURRY_MAX_ARGS, NULL));
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.failures[CURRY_FAILURE_TOO_MANY_ARGS] + 2,
+                           after.failures[CURRY_FAILURE_TOO_MANY_ARGS]);
+  TEST_ASSERT_EQUAL_UINT64(before.failures[CURRY_FAILURE_NO_MEMORY],
+                           after.failures[CURRY_FAILURE_NO_MEMORY]);
+  TEST_ASSERT_EQUAL_UINT64(before.created, after.created);
+}
+
+static void *make_thunks(void *arg) {
+  void **const thunks = arg;
+  for (size_t i = 0; i < 16; i++)
+    thunks[i] = curry_persistent(dut_identity, 1, 0, i);
+  return NULL;
+}
+
+// Check that counts from threads that have exited aren't lost, and that thunks
+// can be freed on a different thread than the one that made them
+void test_threads(void) {
+  curry_stats_t before, after;
+  curry_stats(&before);
+  void *thunks[16];
+  pthread_t thread;
+  TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, make_thunks, thunks));
+  TEST_ASSERT_EQUAL(0, pthread_join(thread, NULL));
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.created + 16, after.created);
+  TEST_ASSERT_EQUAL_UINT64(before.live + 16, after.live);
+
+  for (size_t i = 0; i < 16; i++)
+    curry_free(thunks[i]);
+  curry_stats(&after);
+  TEST_ASSERT_EQUAL_UINT64(before.live, after.live);
+}